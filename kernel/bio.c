@@ -111,16 +111,31 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
-// Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Read n bufs from disk as one batch of requests,
+// waiting once for all of them. The bufs must be locked,
+// or private to the caller and not in the cache.
 void
-brelse(struct buf *b)
+breadv(struct buf **bs, int n)
 {
-  if(!holdingsleep(&b->lock))
-    panic("brelse");
+  virtio_disk_submit(bs, n, 0, 0);
+  virtio_disk_wait(bs, n);
+  for(int i = 0; i < n; i++)
+    bs[i]->valid = 1;
+}
 
-  releasesleep(&b->lock);
+// Write n bufs to disk as one batch; see breadv().
+void
+bwritev(struct buf **bs, int n)
+{
+  virtio_disk_submit(bs, n, 1, 0);
+  virtio_disk_wait(bs, n);
+}
 
+// Drop a reference to an unlocked buffer.
+// Move to the head of the most-recently-used list.
+static void
+bput(struct buf *b)
+{
   acquire(&bcache.lock);
   b->refcnt--;
   if (b->refcnt == 0) {
@@ -136,6 +151,80 @@ brelse(struct buf *b)
   release(&bcache.lock);
 }
 
+// Release a locked buffer.
+void
+brelse(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("brelse");
+
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Called by virtio_disk_intr() when a read started by
+// breadahead() has finished. Runs in interrupt context.
+static void
+breadahead_done(struct buf *b)
+{
+  b->valid = 1;
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Start reading the indicated block into the cache, but don't
+// wait for it. A later bread() finds the buffer either valid or
+// still locked by the read in flight, and waits in acquiresleep().
+// Gives up quietly if the block is already cached, if fewer
+// than NCPU*NBRESERVE unused buffers would remain for bget(),
+// or if there is no free disk descriptor.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b, *victim;
+  int unused;
+
+  acquire(&bcache.lock);
+
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      release(&bcache.lock);
+      return;
+    }
+  }
+
+  // take the least recently used unused buffer, but only
+  // if enough others are left.
+  victim = 0;
+  unused = 0;
+  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+    if(b->refcnt != 0)
+      continue;
+    if(victim == 0)
+      victim = b;
+    if(++unused > NCPU*NBRESERVE)
+      break;
+  }
+  if(unused <= NCPU*NBRESERVE){
+    release(&bcache.lock);
+    return;
+  }
+  b = victim;
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+  release(&bcache.lock);
+
+  // someone may have found the buffer and read the block
+  // between release() and acquiresleep().
+  acquiresleep(&b->lock);
+  if(b->valid || virtio_disk_read_async(b, breadahead_done) < 0){
+    releasesleep(&b->lock);
+    bput(b);
+  }
+}
+
 void
 bpin(struct buf *b) {
   acquire(&bcache.lock);
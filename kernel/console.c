@@ -20,25 +20,27 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "defs.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 
 #define BACKSPACE 0x100  // erase the last output character
 #define C(x)  ((x)-'@')  // Control-x
 
 //
-// send one character to the uart, but don't use
-// interrupts or sleep(). safe to be called from
-// interrupts, e.g. by printf and to echo input
-// characters.
+// send one character to the uart through the kernel
+// output ring; never waits for the uart. safe to be
+// called from interrupts, e.g. to echo input characters.
 //
 void
 consputc(int c)
 {
   if(c == BACKSPACE){
     // if the user typed backspace, overwrite with a space.
-    uartputc_sync('\b'); uartputc_sync(' '); uartputc_sync('\b');
+    klog_write("\b \b", 3);
   } else {
-    uartputc_sync(c);
+    char ch = c;
+    klog_write(&ch, 1);
   }
 }
 
@@ -55,7 +57,7 @@ struct {
 
 //
 // user write() system calls to the console go here.
-// uses sleep() and UART interrupts.
+// goes out through the kernel output ring.
 //
 int
 consolewrite(int user_src, uint64 src, int n)
@@ -0,0 +1,139 @@
+// Directory lookup cache.
+//
+// Remembers where dirlookup() found a name: the inode
+// number and the entry's offset, keyed by (device,
+// directory inode number, name), so that repeated lookups
+// of the same path skip reading the directory.
+//
+// The cache is 4-way set associative, with least recently
+// used replacement within a set. Callers hold the
+// directory's inode lock, which orders lookups against the
+// writei() of a directory entry that changes it; writei()
+// drops entries the write covers, and itrunc() drops all
+// of a directory's entries when it is freed.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+#include "kstat.h"
+
+#define DCWAYS 4
+#define DCSETS (NDCACHE/DCWAYS)
+
+struct dentry {
+  uint dev;
+  uint dir;     // inode number of the directory; 0 if unused
+  char name[DIRSIZ];
+  uint inum;
+  uint off;     // byte offset of the entry in the directory
+  uint64 used;  // dcache.clock at last use
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry set[DCSETS][DCWAYS];
+  uint64 clock;
+  uint64 hits;
+  uint64 misses;
+} dcache;
+
+void
+dcacheinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static struct dentry*
+dcache_set(struct inode *dp, char *name)
+{
+  uint h = dp->dev * 31 + dp->inum;
+
+  for(int i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return dcache.set[h % DCSETS];
+}
+
+// Look up name in directory dp. On a hit, set *inum and
+// *off and return 1. Caller must hold dp->lock.
+int
+dcache_lookup(struct inode *dp, char *name, uint *inum, uint *off)
+{
+  struct dentry *set, *d;
+
+  acquire(&dcache.lock);
+  set = dcache_set(dp, name);
+  for(d = set; d < &set[DCWAYS]; d++){
+    if(d->dir == dp->inum && d->dev == dp->dev && namecmp(d->name, name) == 0){
+      d->used = ++dcache.clock;
+      *inum = d->inum;
+      *off = d->off;
+      dcache.hits++;
+      release(&dcache.lock);
+      return 1;
+    }
+  }
+  dcache.misses++;
+  release(&dcache.lock);
+  return 0;
+}
+
+// Remember that name in directory dp is inode inum, in
+// the entry at offset off. Caller must hold dp->lock.
+void
+dcache_enter(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *set, *d, *victim;
+
+  acquire(&dcache.lock);
+  set = dcache_set(dp, name);
+  victim = set;
+  for(d = set; d < &set[DCWAYS]; d++){
+    if(d->dir == dp->inum && d->dev == dp->dev && namecmp(d->name, name) == 0){
+      victim = d;
+      break;
+    }
+    if(d->used < victim->used)
+      victim = d;
+  }
+  victim->dev = dp->dev;
+  victim->dir = dp->inum;
+  strncpy(victim->name, name, DIRSIZ);
+  victim->inum = inum;
+  victim->off = off;
+  victim->used = ++dcache.clock;
+  release(&dcache.lock);
+}
+
+// Forget the entries of directory dp whose directory
+// entries lie in bytes [off, off+n), or all of them if
+// n is 0. Caller must hold dp->lock.
+void
+dcache_inval(struct inode *dp, uint off, uint n)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = &dcache.set[0][0]; d < &dcache.set[DCSETS][0]; d++){
+    if(d->dir != dp->inum || d->dev != dp->dev)
+      continue;
+    if(n == 0 || (d->off + sizeof(struct dirent) > off && d->off < off + n)){
+      d->dir = 0;
+      d->used = 0;
+    }
+  }
+  release(&dcache.lock);
+}
+
+void
+dcache_stat(struct fs_stat *st)
+{
+  acquire(&dcache.lock);
+  st->dcache_hits = dcache.hits;
+  st->dcache_misses = dcache.misses;
+  release(&dcache.lock);
+}
@@ -2,6 +2,10 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct log_stat;
+struct sched_stat;
+struct vm_stat;
+struct fs_stat;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -13,7 +17,10 @@ struct superblock;
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
+void            breadahead(uint, uint);
 void            bwrite(struct buf*);
+void            breadv(struct buf**, int);
+void            bwritev(struct buf**, int);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
 
@@ -24,6 +31,12 @@ void            consputc(int);
 
 // exec.c
 int             kexec(char*, char**);
+int             execfault(pagetable_t, uint64, uint64*);
+struct inode*   exedup(struct inode*);
+void            exeput(struct inode*);
+void            execshrink(struct proc*, uint64);
+void            execprefault(uint64, uint64);
+int             execoverlaps(uint64, uint64);
 
 // file.c
 struct file*    filealloc(void);
@@ -52,21 +65,29 @@ struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
-void            itrunc(struct inode*);
+int             itrunc(struct inode*);
 void            ireclaim(int);
+void            fs_stat(struct fs_stat*);
 
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+int             kalloc_n(void **, int);
+void            kfree_n(void **, int);
+void*           kalloc_mega(void);
+void            kref(void *);
+int             krefcnt(void *);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+void            log_stat(struct log_stat*);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -75,17 +96,21 @@ int             pipewrite(struct pipe*, uint64, int);
 // printf.c
 int             printf(char*, ...) __attribute__ ((format (printf, 1, 2)));
 void            panic(char*) __attribute__((noreturn));
-void            printfinit(void);
+int             klog_pending(void);
+int             klog_take(char*, int);
+void            klog_write(char*, int);
 
 // proc.c
 int             cpuid(void);
 void            kexit(int);
 int             kfork(void);
+void            kproc(char*, void (*)(void));
 int             growproc(int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kkill(int);
+struct proc*    findproc(int);
 int             killed(struct proc*);
 void            setkilled(struct proc*);
 struct cpu*     mycpu(void);
@@ -97,6 +122,9 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             kwait(uint64);
 void            wakeup(void*);
+void            sched_stat(struct sched_stat*);
+int             procsched_copy_to_user(uint64, int);
+int             procfault_copy_to_user(uint64, int);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
@@ -135,6 +163,7 @@ void            argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+int             syscall_stat_copy_to_user(uint64, int);
 
 // trap.c
 extern uint     ticks;
@@ -142,11 +171,18 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            prepare_return(void);
+void            ipi(int);
+int             kpause(int);
+uint            kuptime(void);
+int             ktickhz(int);
+void            clockidle(void);
+void            clockbusy(void);
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
 void            uartwrite(char [], int);
+void            uartdrain(int);
 void            uartputc_sync(int);
 int             uartgetc(void);
 
@@ -160,15 +196,19 @@ uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
-void            uvmunmap(pagetable_t, uint64, uint64, int);
+int             uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
+pte_t *         walkleaf(pagetable_t, uint64, int *);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 int             ismapped(pagetable_t, uint64);
 uint64          vmfault(pagetable_t, uint64, int);
+void            vm_stat(struct vm_stat *);
+int             kmegapages(int);
+int             kfaultaround(int);
 
 // plic.c
 void            plicinit(void);
@@ -179,6 +219,9 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_submit(struct buf **, int, int, void (*)(struct buf *));
+void            virtio_disk_wait(struct buf **, int);
+int             virtio_disk_read_async(struct buf *, void (*)(struct buf *));
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
@@ -189,4 +232,20 @@ void            lockstat_init(void);
 void            lockstat_record_acquire(struct spinlock*, uint64);
 void            lockstat_record_release(struct spinlock*, uint64);
 void            lockstat_print(void);
-uint64          lockstat_copy_to_user(uint64, int);
\ No newline at end of file
+uint64          lockstat_copy_to_user(uint64, int);
+uint64          lockstat_proc_copy_to_user(int, uint64, int);
+
+// kstat.c
+int             kstat_copy_to_user(int, uint64, int);
+
+// pcache.c
+void            pcacheinit(void);
+char*           pcache_get(struct inode*, uint, uint);
+void            pcache_inval(struct inode*);
+
+// dcache.c
+void            dcacheinit(void);
+int             dcache_lookup(struct inode*, char*, uint*, uint*);
+void            dcache_enter(struct inode*, char*, uint, uint);
+void            dcache_inval(struct inode*, uint, uint);
+void            dcache_stat(struct fs_stat*);
@@ -3,11 +3,16 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
+extern struct vm_stat vmstat;
 
 // map ELF permissions to PTE permission bits.
 int flags2perm(int flags)
@@ -20,6 +25,27 @@ int flags2perm(int flags)
     return perm;
 }
 
+// Take a reference to program ip for a process that will
+// run it. While any process runs a program, its pages may
+// still be loaded from ip, so writei(), itrunc() and open()
+// for writing refuse to change it. The first reference must
+// be taken with ip locked, which orders it against writers.
+struct inode*
+exedup(struct inode *ip)
+{
+  __sync_fetch_and_add(&ip->running, 1);
+  return idup(ip);
+}
+
+// Drop a reference taken by exedup().
+// Must be called inside a transaction, as for iput().
+void
+exeput(struct inode *ip)
+{
+  __sync_fetch_and_sub(&ip->running, 1);
+  iput(ip);
+}
+
 //
 // the implementation of the exec() system call
 //
@@ -32,6 +58,9 @@ kexec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
+  struct execseg segs[NEXECSEG];
+  int nseg = 0;
+  struct inode *exe = 0, *oldexe;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
@@ -55,7 +84,8 @@ kexec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments. execfault() loads
+  // their pages from ip when the program touches them.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -67,13 +97,18 @@ kexec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
-      goto bad;
-    sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.vaddr + ph.memsz > TRAPFRAME || nseg == NEXECSEG)
       goto bad;
+    segs[nseg].va = ph.vaddr;
+    segs[nseg].memsz = ph.memsz;
+    segs[nseg].filesz = ph.filesz;
+    segs[nseg].off = ph.off;
+    segs[nseg].perm = flags2perm(ph.flags);
+    nseg++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
+  exe = exedup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
@@ -129,11 +164,22 @@ kexec(char *path, char **argv)
     
   // Commit to the user image.
   oldpagetable = p->pagetable;
+  oldexe = p->exe;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->exe = exe;
+  memmove(p->segs, segs, sizeof(segs));
+  p->nseg = nseg;
+  for(i = 0; i < nseg; i++)
+    __sync_fetch_and_add(&vmstat.exec_pages, PGROUNDUP(segs[i].memsz) / PGSIZE);
   p->trapframe->epc = elf.entry;  // initial program counter = ulib.c:start()
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  if(oldexe){
+    begin_op();
+    exeput(oldexe);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -144,30 +190,128 @@ kexec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    begin_op();
+    exeput(exe);
+    end_op();
+  }
   return -1;
 }
 
-// Load an ELF program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
+// read n bytes at offset off of ip into the kernel
+// page mem. ip is locked unless the faulting system
+// call already holds it.
 static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+execread(struct inode *ip, char *mem, uint off, uint n)
+{
+  int held = holdingsleep(&ip->lock);
+  int r;
+
+  if(!held)
+    ilock(ip);
+  r = readi(ip, 0, (uint64)mem, off, n);
+  if(!held)
+    iunlock(ip);
+  return r == n ? 0 : -1;
+}
+
+// Load the page at va of the current process's program
+// on its first touch. Read-only pages come from the
+// shared page cache; writable ones are private copies.
+// Returns 1 and sets *pa to the physical address if it
+// loaded the page, 0 if va is not in a loadable segment,
+// or -1 if va is in one but the page can't be loaded.
+int
+execfault(pagetable_t pagetable, uint64 va, uint64 *pa)
 {
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
+  struct proc *p = myproc();
+  struct execseg *s;
+  uint64 off, n;
+  char *mem;
+
+  for(s = p->segs; s < &p->segs[p->nseg]; s++)
+    if(va >= s->va && va < s->va + s->memsz)
+      break;
+  if(s == &p->segs[p->nseg])
+    return 0;
+
+  off = va - s->va;
+  n = off < s->filesz ? s->filesz - off : 0;
+  if(n > PGSIZE)
+    n = PGSIZE;
+  if(n > 0 && (s->perm & PTE_W) == 0){
+    if((mem = pcache_get(p->exe, s->off + off, n)) == 0)
+      return -1;
+    __sync_fetch_and_add(&vmstat.exec_shared, 1);
+  } else {
+    if((mem = kalloc()) == 0)
       return -1;
+    memset(mem, 0, PGSIZE);
+    if(n > 0 && execread(p->exe, mem, s->off + off, n) < 0){
+      kfree(mem);
+      return -1;
+    }
+  }
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_R|PTE_U|s->perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  __sync_fetch_and_add(&vmstat.exec_faults, 1);
+  p->faults.exec++;
+  *pa = (uint64)mem;
+  return 1;
+}
+
+// Load the not yet touched program pages that overlap
+// the user buffer [va, va+len), ahead of a copyin() or
+// copyout() done while holding a lock, since loading
+// may sleep. Errors are left for the copy to report.
+void
+execprefault(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct execseg *s;
+  uint64 a, end, pa;
+
+  if(va + len < va)
+    return;
+  for(s = p->segs; s < &p->segs[p->nseg]; s++){
+    a = va > s->va ? PGROUNDDOWN(va) : s->va;
+    end = va + len < s->va + s->memsz ? va + len : s->va + s->memsz;
+    for(; a < end; a += PGSIZE)
+      if(walkaddr(p->pagetable, a) == 0 && execfault(p->pagetable, a, &pa) < 0)
+        return;
   }
-  
+}
+
+// Does [va, va+len) overlap a segment of the current
+// process's program?
+int
+execoverlaps(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct execseg *s;
+
+  for(s = p->segs; s < &p->segs[p->nseg]; s++)
+    if(va < s->va + s->memsz && s->va < va + len)
+      return 1;
   return 0;
 }
+
+// The process shrank to sz bytes; forget the parts of
+// its segments beyond that, so that growing again
+// gives zeroed memory.
+void
+execshrink(struct proc *p, uint64 sz)
+{
+  struct execseg *s;
+
+  for(s = p->segs; s < &p->segs[p->nseg]; s++){
+    if(s->va >= sz)
+      s->memsz = s->filesz = 0;
+    else if(s->va + s->memsz > sz)
+      s->memsz = sz - s->va;
+    if(s->filesz > s->memsz)
+      s->filesz = s->memsz;
+  }
+}
@@ -11,6 +11,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 
 struct devsw devsw[NDEV];
@@ -110,6 +112,7 @@ fileread(struct file *f, uint64 addr, int n)
 
   if(f->readable == 0)
     return -1;
+  execprefault(addr, n);
 
   if(f->type == FD_PIPE){
     r = piperead(f->pipe, addr, n);
@@ -138,6 +141,7 @@ filewrite(struct file *f, uint64 addr, int n)
 
   if(f->writable == 0)
     return -1;
+  execprefault(addr, n);
 
   if(f->type == FD_PIPE){
     ret = pipewrite(f->pipe, addr, n);
@@ -148,9 +152,9 @@ filewrite(struct file *f, uint64 addr, int n)
   } else if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
+    // i-node, two levels of indirect block, allocation blocks,
     // and 2 blocks of slop for non-aligned writes.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+    int max = ((MAXOPBLOCKS-1-2-2) / 2) * BSIZE;
     int i = 0;
     while(i < n){
       int n1 = n - i;
@@ -13,20 +13,38 @@ struct file {
 #define minor(dev)  ((dev) & 0xFFFF)
 #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
 
+#define NEXTENT 4  // runs of block addresses cached per inode
+
 // in-memory copy of an inode
 struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext;  // next in itable hash chain
+  struct inode *fnext;  // itable free list, if free
+  struct inode *fprev;
+  int free;           // on the itable free list?
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
+  uint ranext;        // block after the last one readi() returned
+  uint rawin;         // read-ahead window, in blocks (0 if not sequential)
+  uint raend;         // read-ahead has been started up to this block
+  int pcached;        // may have pages in the page cache, see pcache.c
+  int running;        // processes running this program, see exedup()
+  struct {            // runs of consecutive blocks, see bmap()
+    uint bn;          // first block of the run in the file
+    uint addr;        // ... and on disk
+    uint len;         // 0 if unused
+  } ext[NEXTENT];
+  uint extnext;       // ext[] slot to replace next
+
   short type;         // copy of disk inode
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
 };
 
 // map major device number to device functions.
@@ -15,6 +15,8 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
@@ -26,6 +28,8 @@
 // only one device
 struct superblock sb; 
 
+static void bfreeinit(int);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -44,6 +48,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  bfreeinit(dev);
   ireclaim(dev);
 }
 
@@ -60,27 +65,109 @@ bzero(int dev, int bno)
 }
 
 // Blocks.
+//
+// bfreemap summarizes the on-disk free bitmap: the number
+// of free blocks each bitmap block describes, so balloc()
+// reads only bitmap blocks that have a free block, and a
+// cursor just past the last block allocated, where an
+// allocation with no goal starts looking. The counts are
+// built when the file system is mounted and change only
+// while the bitmap block's buffer is locked.
+
+typedef uint64 __attribute__((__may_alias__)) bword;
+
+struct {
+  struct spinlock lock;
+  uint *nfree;   // free blocks per bitmap block
+  uint nbmap;    // number of bitmap blocks
+  uint cursor;
+  uint64 free;   // free blocks in all
+} bfreemap;
+
+// Number of bits of bitmap block bi that describe blocks.
+static int
+bbits(uint bi)
+{
+  return min(BPB, sb.size - bi * BPB);
+}
+
+// Return the first clear bit in [lo, hi) of map, or -1.
+// Skips a 64-bit word at a time over full stretches.
+static int
+bfirst(uchar *map, int lo, int hi)
+{
+  int i = lo;
+
+  for(; i < hi && i % 64; i++)
+    if((map[i/8] & (1 << (i % 8))) == 0)
+      return i;
+  while(i + 64 <= hi && ((bword*)map)[i/64] == ~0ULL)
+    i += 64;
+  for(; i < hi; i++)
+    if((map[i/8] & (1 << (i % 8))) == 0)
+      return i;
+  return -1;
+}
 
-// Allocate a zeroed disk block.
+static void
+bfreeinit(int dev)
+{
+  struct buf *bp;
+
+  initlock(&bfreemap.lock, "bfreemap");
+  bfreemap.nbmap = (sb.size + BPB - 1) / BPB;
+  if(bfreemap.nbmap > PGSIZE / sizeof(uint) ||
+     (bfreemap.nfree = kalloc()) == 0)
+    panic("bfreeinit");
+  for(uint bi = 0; bi < bfreemap.nbmap; bi++){
+    int n = 0, i = 0;
+
+    bp = bread(dev, sb.bmapstart + bi);
+    while((i = bfirst(bp->data, i, bbits(bi))) >= 0){
+      n++;
+      i++;
+    }
+    brelse(bp);
+    bfreemap.nfree[bi] = n;
+    bfreemap.free += n;
+  }
+}
+
+// Allocate a zeroed disk block, preferably goal, or the
+// first free block after it; a goal of 0 means after the
+// last block allocated.
 // returns 0 if out of disk space.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal)
 {
-  int b, bi, m;
+  int b, bi, n;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+  if(goal == 0 || goal >= sb.size)
+    goal = __atomic_load_n(&bfreemap.cursor, __ATOMIC_RELAXED) % sb.size;
+
+  // visit goal's bitmap block twice: from goal to its end
+  // first, and last from its start up to goal.
+  for(n = 0; n <= bfreemap.nbmap; n++){
+    uint bbase = (goal / BPB + n) % bfreemap.nbmap;
+    int lo = n == 0 ? goal % BPB : 0;
+    int hi = n == bfreemap.nbmap ? goal % BPB : bbits(bbase);
+
+    if(__atomic_load_n(&bfreemap.nfree[bbase], __ATOMIC_RELAXED) == 0)
+      continue;
+    bp = bread(dev, sb.bmapstart + bbase);
+    if((bi = bfirst(bp->data, lo, hi)) >= 0){
+      bp->data[bi/8] |= 1 << (bi % 8);  // Mark block in use.
+      log_write(bp);
+      b = bbase * BPB + bi;
+      acquire(&bfreemap.lock);
+      bfreemap.nfree[bbase]--;
+      bfreemap.free--;
+      bfreemap.cursor = b + 1;
+      release(&bfreemap.lock);
+      brelse(bp);
+      bzero(dev, b);
+      return b;
     }
     brelse(bp);
   }
@@ -102,6 +189,10 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  acquire(&bfreemap.lock);
+  bfreemap.nfree[b / BPB]++;
+  bfreemap.free++;
+  release(&bfreemap.lock);
   brelse(bp);
 }
 
@@ -135,13 +226,16 @@ bfree(int dev, uint b)
 //   the number of in-memory pointers to the entry (open
 //   files and current directories). iget() finds or
 //   creates a table entry and increments its ref; iput()
-//   decrements ref.
+//   decrements ref. A free entry stays in the table, on
+//   the free list, until iget() recycles it for another
+//   inode, so a later iget() of the same inode finds it.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid if it frees the inode on disk, and iget()
+//   clears it when it recycles the entry.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -165,28 +259,148 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// The table is a hash of (dev, inum) into NIHASH chains.
+// Each chain's spin-lock protects ip->ref, ip->dev, ip->inum
+// and ip->hnext of the entries on it, so iget(), idup() and
+// iput() of inodes in different chains don't contend.
+// The itable.lock spin-lock protects the free list of entries
+// with ref zero; ip->free says whether an entry is on it, and
+// changes only with both locks held. Lock order is chain lock,
+// then itable.lock.
+//
+// Entries are allocated a page at a time. The table grows
+// until it holds NINODE entries and after that only when
+// every entry is in use; it never shrinks.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum, and the list links.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 31
+
+struct ihash {
+  struct spinlock lock;
+  struct inode *head;
+};
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct ihash hash[NIHASH];
+  struct inode free;  // free list, least recently used first
+  int n;              // entries allocated
+  uint64 hits;
+  uint64 misses;
 } itable;
 
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+  for(int i = 0; i < NIHASH; i++)
+    initlock(&itable.hash[i].lock, "ihash");
+  itable.free.fnext = &itable.free;
+  itable.free.fprev = &itable.free;
+}
+
+static struct ihash*
+ihash(uint dev, uint inum)
+{
+  return &itable.hash[(dev * 31 + inum) % NIHASH];
+}
+
+// Take ip off the free list.
+// Caller holds ip's chain lock and itable.lock.
+static void
+ifree_remove(struct inode *ip)
+{
+  ip->fprev->fnext = ip->fnext;
+  ip->fnext->fprev = ip->fprev;
+  ip->free = 0;
+}
+
+// Put ip on the free list, at the tail unless it holds
+// no inode. Caller holds itable.lock, and ip's chain lock
+// if it is in one.
+static void
+ifree_insert(struct inode *ip)
+{
+  struct inode *at = ip->inum ? itable.free.fprev : &itable.free;
+
+  ip->fnext = at->fnext;
+  ip->fprev = at;
+  at->fnext->fprev = ip;
+  at->fnext = ip;
+  ip->free = 1;
+}
+
+// Add a page of entries to the free list.
+// Caller holds itable.lock.
+static int
+igrow(void)
+{
+  struct inode *ip;
+  int n = PGSIZE / sizeof(struct inode);
+
+  if((ip = kalloc()) == 0)
+    return -1;
+  memset(ip, 0, PGSIZE);
+  for(; n > 0; n--, ip++){
+    initsleeplock(&ip->lock, "inode");
+    ifree_insert(ip);
+    itable.n++;
+  }
+  return 0;
+}
+
+// Take an entry with ref zero out of the table, growing
+// the table if it is small or has no free entries.
+// Returns the entry off the free list and out of its
+// chain, or 0 if there is none and no memory to grow.
+static struct inode*
+irecycle(void)
+{
+  struct inode *ip;
+  struct ihash *h;
+  uint dev, inum;
+
+  for(;;){
+    acquire(&itable.lock);
+    if(itable.n < NINODE || itable.free.fnext == &itable.free)
+      igrow();
+    ip = itable.free.fnext;
+    if(ip == &itable.free){
+      release(&itable.lock);
+      return 0;
+    }
+    if(ip->inum == 0){
+      // never used, or put back by iget(); in no chain.
+      ifree_remove(ip);
+      release(&itable.lock);
+      return ip;
+    }
+    dev = ip->dev;
+    inum = ip->inum;
+    release(&itable.lock);
+
+    // take the chain lock first, then check that ip is
+    // still free and still holds the same inode.
+    h = ihash(dev, inum);
+    acquire(&h->lock);
+    acquire(&itable.lock);
+    if(ip->free && ip->dev == dev && ip->inum == inum){
+      struct inode **pp;
+
+      ifree_remove(ip);
+      release(&itable.lock);
+      for(pp = &h->head; *pp != ip; pp = &(*pp)->hnext)
+        ;
+      *pp = ip->hnext;
+      ip->inum = 0;
+      release(&h->lock);
+      return ip;
+    }
+    release(&itable.lock);
+    release(&h->lock);
   }
 }
 
@@ -241,38 +455,65 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+// Look for the inode in chain h and take a reference.
+// Caller holds h->lock.
+static struct inode*
+ifind(struct ihash *h, uint dev, uint inum)
+{
+  struct inode *ip;
+
+  for(ip = h->head; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0){
+        acquire(&itable.lock);
+        ifree_remove(ip);
+        release(&itable.lock);
+      }
+      return ip;
+    }
+  }
+  return 0;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
-
-  acquire(&itable.lock);
+  struct ihash *h = ihash(dev, inum);
+  struct inode *ip, *new;
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&itable.lock);
-      return ip;
-    }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+  acquire(&h->lock);
+  ip = ifind(h, dev, inum);
+  release(&h->lock);
+  if(ip){
+    __sync_fetch_and_add(&itable.hits, 1);
+    return ip;
   }
+  __sync_fetch_and_add(&itable.misses, 1);
 
-  // Recycle an inode entry.
-  if(empty == 0)
+  // Recycle an inode entry, then look again, since another
+  // iget() may have added the inode meanwhile.
+  if((new = irecycle()) == 0)
     panic("iget: no inodes");
-
-  ip = empty;
+  acquire(&h->lock);
+  if((ip = ifind(h, dev, inum)) != 0){
+    release(&h->lock);
+    acquire(&itable.lock);
+    ifree_insert(new);
+    release(&itable.lock);
+    return ip;
+  }
+  ip = new;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
-  release(&itable.lock);
+  ip->hnext = h->head;
+  h->head = ip;
+  release(&h->lock);
 
   return ip;
 }
@@ -282,9 +523,11 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct ihash *h = ihash(ip->dev, ip->inum);
+
+  acquire(&h->lock);
   ip->ref++;
-  release(&itable.lock);
+  release(&h->lock);
   return ip;
 }
 
@@ -311,6 +554,11 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->ranext = 0;
+    ip->rawin = 0;
+    ip->raend = 0;
+    memset(ip->ext, 0, sizeof(ip->ext));
+    ip->pcached = 1;  // pages may be cached from an earlier life
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -337,7 +585,9 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct ihash *h = ihash(ip->dev, ip->inum);
+
+  acquire(&h->lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -346,7 +596,7 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&itable.lock);
+    release(&h->lock);
 
     itrunc(ip);
     ip->type = 0;
@@ -355,11 +605,15 @@ iput(struct inode *ip)
 
     releasesleep(&ip->lock);
 
-    acquire(&itable.lock);
+    acquire(&h->lock);
   }
 
-  ip->ref--;
-  release(&itable.lock);
+  if(--ip->ref == 0){
+    acquire(&itable.lock);
+    ifree_insert(ip);
+    release(&itable.lock);
+  }
+  release(&h->lock);
 }
 
 // Common idiom: unlock, then put.
@@ -397,7 +651,88 @@ ireclaim(int dev)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The next NDINDIRECT
+// are listed in the blocks listed in block ip->addrs[NDIRECT+1].
+//
+// So that reading a big file doesn't read an indirect block
+// for every block of data, bmap() remembers in ip->ext[] the
+// runs of consecutive disk blocks it finds in indirect blocks.
+// Blocks stay mapped until itrunc(), so the runs stay valid.
+
+struct {
+  uint64 hits;    // bmap()s answered from ip->ext[]
+  uint64 misses;  // ... that read an indirect block
+} bmapstat;
+
+// Block to try first when allocating after block prev
+// of a file: the next one on disk, so that files written
+// sequentially are laid out sequentially.
+static uint
+bgoal(uint prev)
+{
+  return prev ? prev + 1 : 0;
+}
+
+// Look up file block bn in the runs cached in ip->ext[].
+// Returns 0 if it isn't in any.
+static uint
+bextent(struct inode *ip, uint bn)
+{
+  for(int i = 0; i < NEXTENT; i++){
+    if(bn - ip->ext[i].bn < ip->ext[i].len)
+      return ip->ext[i].addr + (bn - ip->ext[i].bn);
+  }
+  return 0;
+}
+
+// File block bn is at disk block a[0]; remember the run of
+// consecutive disk blocks starting there, looking no further
+// than a[n-1]. Extends a cached run that ends just before it.
+static void
+bextent_add(struct inode *ip, uint bn, uint *a, uint n)
+{
+  uint len;
+  int i;
+
+  for(len = 1; len < n && a[len] == a[0] + len; len++)
+    ;
+  for(i = 0; i < NEXTENT; i++){
+    if(ip->ext[i].len && ip->ext[i].bn + ip->ext[i].len == bn &&
+       ip->ext[i].addr + ip->ext[i].len == a[0]){
+      ip->ext[i].len += len;
+      return;
+    }
+  }
+  i = ip->extnext++ % NEXTENT;
+  ip->ext[i].bn = bn;
+  ip->ext[i].addr = a[0];
+  ip->ext[i].len = len;
+}
+
+// Return entry i of indirect block blk, allocating a block
+// for it if there is none. If the entry maps file block bn
+// (0 if it maps another indirect block), cache the run of
+// blocks it starts.
+static uint
+bentry(struct inode *ip, uint blk, uint i, uint bn)
+{
+  uint addr, *a;
+  struct buf *bp;
+
+  bp = bread(ip->dev, blk);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0){
+    addr = balloc(ip->dev, bgoal(i > 0 ? a[i-1] : blk));
+    if(addr){
+      a[i] = addr;
+      log_write(bp);
+    }
+  }
+  if(addr && bn)
+    bextent_add(ip, bn, &a[i], NINDIRECT - i);
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
@@ -405,53 +740,89 @@ ireclaim(int dev)
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
-  struct buf *bp;
+  uint addr, n;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0){
-      addr = balloc(ip->dev);
+      addr = balloc(ip->dev, bn > 0 ? bgoal(ip->addrs[bn-1]) : 0);
       if(addr == 0)
         return 0;
       ip->addrs[bn] = addr;
     }
     return addr;
   }
-  bn -= NDIRECT;
 
-  if(bn < NINDIRECT){
+  if((addr = bextent(ip, bn)) != 0){
+    __sync_fetch_and_add(&bmapstat.hits, 1);
+    return addr;
+  }
+  __sync_fetch_and_add(&bmapstat.misses, 1);
+  n = bn - NDIRECT;
+
+  if(n < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0){
-      addr = balloc(ip->dev);
+      addr = balloc(ip->dev, bgoal(ip->addrs[NDIRECT-1]));
       if(addr == 0)
         return 0;
       ip->addrs[NDIRECT] = addr;
     }
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      addr = balloc(ip->dev);
-      if(addr){
-        a[bn] = addr;
-        log_write(bp);
-      }
+    return bentry(ip, addr, n, bn);
+  }
+  n -= NINDIRECT;
+
+  if(n < NDINDIRECT){
+    // Load the double-indirect block, then the indirect
+    // block it lists, allocating if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0){
+      addr = balloc(ip->dev, 0);
+      if(addr == 0)
+        return 0;
+      ip->addrs[NDIRECT+1] = addr;
     }
-    brelse(bp);
-    return addr;
+    if((addr = bentry(ip, addr, n / NINDIRECT, 0)) == 0)
+      return 0;
+    return bentry(ip, addr, n % NINDIRECT, bn);
   }
 
   panic("bmap: out of range");
 }
 
+// Free indirect block addr and the blocks it lists,
+// those being indirect blocks too if depth is 2.
+static void
+bfreeindirect(struct inode *ip, uint addr, int depth)
+{
+  struct buf *bp;
+  uint *a;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  for(int j = 0; j < NINDIRECT; j++){
+    if(a[j] == 0)
+      continue;
+    if(depth > 1)
+      bfreeindirect(ip, a[j], depth - 1);
+    else
+      bfree(ip->dev, a[j]);
+  }
+  brelse(bp);
+  bfree(ip->dev, addr);
+}
+
 // Truncate inode (discard contents).
+// Fails if a process is running the program in ip.
 // Caller must hold ip->lock.
-void
+int
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
 
+  if(ip->running)
+    return -1;
+  pcache_inval(ip);
+  if(ip->type == T_DIR)
+    dcache_inval(ip, 0, 0);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -460,19 +831,19 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
-    }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
+    bfreeindirect(ip, ip->addrs[NDIRECT], 1);
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    bfreeindirect(ip, ip->addrs[NDIRECT+1], 2);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+  memset(ip->ext, 0, sizeof(ip->ext));
+
   ip->size = 0;
   iupdate(ip);
+  return 0;
 }
 
 // Copy stat information from inode.
@@ -487,6 +858,45 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Sequential read detection for readi(), which has just read
+// blocks bn up to (but not including) next. If this read started
+// where the previous one stopped, grow the inode's read-ahead
+// window and start reading the blocks beyond next, so that the
+// disk works on them while the caller consumes what it has.
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint bn, uint next)
+{
+  uint addr, end, nblocks;
+
+  // bn+1 == ranext: this read continues in the (partial) block
+  // where the previous one stopped.
+  if(bn == ip->ranext || bn + 1 == ip->ranext){
+    if(ip->rawin == 0)
+      ip->rawin = 2;
+    else if(ip->rawin < NREADAHEAD)
+      ip->rawin = min(ip->rawin * 2, NREADAHEAD);
+  } else {
+    ip->rawin = 0;
+    ip->raend = 0;
+  }
+  ip->ranext = next;
+  if(ip->rawin == 0)
+    return;
+
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  end = min(next + ip->rawin, nblocks);
+  if(ip->raend < next)
+    ip->raend = next;
+  for(; ip->raend < end; ip->raend++){
+    // blocks below ip->size are always allocated,
+    // so bmap() won't call balloc().
+    if((addr = bmap(ip, ip->raend)) == 0)
+      break;
+    breadahead(ip->dev, addr);
+  }
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -494,13 +904,14 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, bn;
   struct buf *bp;
 
   if(off > ip->size || off + n < off)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
+  bn = off/BSIZE;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     uint addr = bmap(ip, off/BSIZE);
@@ -515,6 +926,8 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     }
     brelse(bp);
   }
+  if(tot != -1 && tot > 0)
+    readahead(ip, bn, (off + BSIZE - 1)/BSIZE);
   return tot;
 }
 
@@ -535,7 +948,12 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(ip->running)  // see exedup()
+    return -1;
 
+  pcache_inval(ip);
+  if(ip->type == T_DIR)
+    dcache_inval(ip, off, n);
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
@@ -580,6 +998,12 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dcache_lookup(dp, name, &inum, &off)){
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -590,6 +1014,7 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if(poff)
         *poff = off;
       inum = de.inum;
+      dcache_enter(dp, name, inum, off);
       return iget(dp->dev, inum);
     }
   }
@@ -624,6 +1049,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     return -1;
+  dcache_enter(dp, name, inum, off);
 
   return 0;
 }
@@ -718,3 +1144,17 @@ nameiparent(char *path, char *name)
 {
   return namex(path, 1, name);
 }
+
+void
+fs_stat(struct fs_stat *st)
+{
+  dcache_stat(st);
+  st->blocks_free = __atomic_load_n(&bfreemap.free, __ATOMIC_RELAXED);
+  st->bmap_hits = bmapstat.hits;
+  st->bmap_misses = bmapstat.misses;
+  acquire(&itable.lock);
+  st->inodes = itable.n;
+  st->iget_hits = itable.hits;
+  st->iget_misses = itable.misses;
+  release(&itable.lock);
+}
@@ -1,6 +1,7 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// and 2 MiB megapages from a pool at the top of memory.
 
 #include "types.h"
 #include "param.h"
@@ -18,16 +19,43 @@ struct run {
   struct run *next;
 };
 
+// a 2 MiB run of the megapage pool. its 4096-byte pages are
+// reference counted one by one, so that a megapage can be
+// split into ordinary mappings; the run is free again once
+// all 512 have been freed.
+struct mega {
+  struct mega *next;
+  int nfree;   // pages freed since the run was handed out
+  int broken;  // split up onto the ordinary free list for good
+};
+
 struct {
   struct spinlock lock;
   struct run *freelist;
+  struct mega *megafree;
+  struct mega mega[NMEGAPAGE];
+  uint64 megabase;  // start of the megapage pool
+  int ref[(PHYSTOP-KERNBASE)/PGSIZE]; // references to each page
 } kmem;
 
+#define PA2REF(pa) (kmem.ref[((uint64)(pa) - KERNBASE) >> PGSHIFT])
+#define PA2MEGA(pa) (&kmem.mega[((uint64)(pa) - kmem.megabase) / MEGASIZE])
+#define MEGA2PA(m) (kmem.megabase + ((m) - kmem.mega) * MEGASIZE)
+
 void
 kinit()
 {
+  struct mega *m;
+
   initlock(&kmem.lock, "kmem");
-  freerange(end, (void*)PHYSTOP);
+  kmem.megabase = PHYSTOP - NMEGAPAGE*MEGASIZE;
+  if(kmem.megabase < PGROUNDUP((uint64)end))
+    panic("kinit: megapages");
+  freerange(end, (void*)kmem.megabase);
+  for(m = &kmem.mega[NMEGAPAGE-1]; m >= kmem.mega; m--){
+    m->next = kmem.megafree;
+    kmem.megafree = m;
+  }
 }
 
 void
@@ -35,30 +63,91 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    PA2REF(p) = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
-void
-kfree(void *pa)
+// Drop a reference to page pa. Returns 1, with the
+// page filled with junk, if that was the last one.
+static int
+kput(void *pa)
 {
-  struct run *r;
+  int n;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if((n = __sync_sub_and_fetch(&PA2REF(pa), 1)) < 0)
+    panic("kfree: ref");
+  if(n > 0)
+    return 0;
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+  return 1;
+}
 
-  r = (struct run*)pa;
+// Put page pa, whose last reference is gone, on a free
+// list. Pages of a megapage run go back to the run.
+// Called with kmem.lock held.
+static void
+kpush(void *pa)
+{
+  struct run *r = (struct run*)pa;
+  struct mega *m;
 
-  acquire(&kmem.lock);
+  if((uint64)pa >= kmem.megabase){
+    m = PA2MEGA(pa);
+    if(!m->broken){
+      if(++m->nfree == MEGASIZE/PGSIZE){
+        m->nfree = 0;
+        m->next = kmem.megafree;
+        kmem.megafree = m;
+      }
+      return;
+    }
+  }
   r->next = kmem.freelist;
   kmem.freelist = r;
+}
+
+// The ordinary free list is empty: split a free megapage
+// run onto it. Returns 0 if there was none.
+// Called with kmem.lock held.
+static int
+ksplit(void)
+{
+  struct mega *m;
+  struct run *r;
+  uint64 pa;
+
+  if((m = kmem.megafree) == 0)
+    return 0;
+  kmem.megafree = m->next;
+  m->broken = 1;
+  for(pa = MEGA2PA(m); pa < MEGA2PA(m) + MEGASIZE; pa += PGSIZE){
+    r = (struct run*)pa;
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+  }
+  return 1;
+}
+
+// Drop a reference to the page of physical memory pointed
+// at by pa, and free it if that was the last one. pa
+// normally should have been returned by a call to kalloc().
+// (The exception is when initializing the allocator; see
+// kinit above.)
+void
+kfree(void *pa)
+{
+  if(!kput(pa))
+    return;
+
+  acquire(&kmem.lock);
+  kpush(pa);
   release(&kmem.lock);
 }
 
@@ -71,12 +160,100 @@ kalloc(void)
   struct run *r;
 
   acquire(&kmem.lock);
+  if(kmem.freelist == 0)
+    ksplit();
   r = kmem.freelist;
   if(r)
     kmem.freelist = r->next;
   release(&kmem.lock);
 
-  if(r)
+  if(r){
+    PA2REF(r) = 1;
     memset((char*)r, 5, PGSIZE); // fill with junk
+  }
   return (void*)r;
 }
+
+// Allocate up to n pages, taking kmem.lock once.
+// Stores them in pa[] and returns how many there were.
+int
+kalloc_n(void **pa, int n)
+{
+  struct run *r;
+  int i;
+
+  acquire(&kmem.lock);
+  for(i = 0; i < n; i++){
+    if(kmem.freelist == 0 && !ksplit())
+      break;
+    r = kmem.freelist;
+    kmem.freelist = r->next;
+    pa[i] = r;
+  }
+  release(&kmem.lock);
+
+  for(int j = 0; j < i; j++){
+    PA2REF(pa[j]) = 1;
+    memset(pa[j], 5, PGSIZE); // fill with junk
+  }
+  return i;
+}
+
+// kfree() each of the n pages in pa[], putting the
+// freed ones on the free list with one kmem.lock acquire.
+void
+kfree_n(void **pa, int n)
+{
+  int i, nfree = 0;
+
+  // keep the pages to free at the front of pa[].
+  for(i = 0; i < n; i++)
+    if(kput(pa[i]))
+      pa[nfree++] = pa[i];
+  if(nfree == 0)
+    return;
+
+  acquire(&kmem.lock);
+  for(i = 0; i < nfree; i++)
+    kpush(pa[i]);
+  release(&kmem.lock);
+}
+
+// Allocate a 2 MiB megapage, aligned to its size, whose
+// 512 pages each hold one reference. The contents are not
+// cleared. Returns 0 if the pool is empty.
+void *
+kalloc_mega(void)
+{
+  struct mega *m;
+  uint64 pa, a;
+
+  acquire(&kmem.lock);
+  if((m = kmem.megafree) != 0)
+    kmem.megafree = m->next;
+  release(&kmem.lock);
+  if(m == 0)
+    return 0;
+
+  pa = MEGA2PA(m);
+  for(a = pa; a < pa + MEGASIZE; a += PGSIZE)
+    PA2REF(a) = 1;
+  return (void*)pa;
+}
+
+// Take another reference to an allocated page, which
+// copy-on-write fork shares between page tables.
+void
+kref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kref");
+  __sync_fetch_and_add(&PA2REF(pa), 1);
+}
+
+// Number of references to an allocated page.
+int
+krefcnt(void *pa)
+{
+  return __atomic_load_n(&PA2REF(pa), __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,63 @@
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
+#include "proc.h"
+
+// Copy statistics of the given kind to user address addr,
+// at most n bytes. Returns the number of bytes copied.
+int
+kstat_copy_to_user(int kind, uint64 addr, int n)
+{
+  union {
+    struct log_stat log;
+    struct sched_stat sched;
+    struct vm_stat vm;
+    struct fs_stat fs;
+  } u;
+  int sz;
+
+  switch(kind){
+  case KSTAT_LOG:
+    log_stat(&u.log);
+    sz = sizeof(u.log);
+    break;
+  case KSTAT_SCHED:
+    sched_stat(&u.sched);
+    sz = sizeof(u.sched);
+    break;
+  case KSTAT_PROC:
+    if(n < 0)
+      return -1;
+    return procsched_copy_to_user(addr, n);
+  case KSTAT_SYSCALL:
+    if(n < 0)
+      return -1;
+    return syscall_stat_copy_to_user(addr, n);
+  case KSTAT_PROCVM:
+    if(n < 0)
+      return -1;
+    return procfault_copy_to_user(addr, n);
+  case KSTAT_VM:
+    vm_stat(&u.vm);
+    sz = sizeof(u.vm);
+    break;
+  case KSTAT_FS:
+    fs_stat(&u.fs);
+    sz = sizeof(u.fs);
+    break;
+  default:
+    return -1;
+  }
+
+  if(n < 0)
+    return -1;
+  if(n > sz)
+    n = sz;
+  if(copyout(myproc()->pagetable, addr, (char *)&u, n) < 0)
+    return -1;
+  return n;
+}
@@ -0,0 +1,99 @@
+// Kernel statistics, copied out by the kstat() system call.
+// Shared by the kernel and user programs; keep it free of
+// kernel-only types.
+#ifndef KSTAT_H
+#define KSTAT_H
+
+#define KSTAT_LOG    1  // struct log_stat
+#define KSTAT_SCHED  2  // struct sched_stat, whole system
+#define KSTAT_PROC   3  // struct proc_sched_stat per process
+#define KSTAT_SYSCALL 4 // struct syscall_stat per syscall number
+#define KSTAT_VM     5  // struct vm_stat
+#define KSTAT_PROCVM 6  // struct proc_fault_stat per process
+#define KSTAT_FS     7  // struct fs_stat
+
+// logging layer
+struct log_stat {
+  uint64 size;              // data blocks in the on-disk log
+  uint64 commits;           // commits by the committer thread
+  uint64 trans;             // FS system calls they covered
+  uint64 blocks;            // blocks written to the log
+  uint64 max_blocks;        // largest commit, in blocks
+  uint64 commit_cycles;     // total time spent in commit()
+  uint64 max_commit_cycles; // slowest commit()
+  uint64 writes;            // log_write() calls
+  uint64 absorbed;          // ... of blocks already in the log
+  uint64 waits;             // begin_op() sleeps for log space
+  uint64 wait_cycles;       // total time they slept
+};
+
+// scheduler. times are in timer cycles (r_time()).
+#define NSCHEDHIST 24  // log2 histogram buckets; the last is open-ended
+
+struct sched_stat {
+  uint64 nvcsw;     // voluntary context switches, in sleep()
+  uint64 nivcsw;    // involuntary ones, in yield()
+  uint64 runs;      // times picked by scheduler()
+  uint64 delay;     // total time RUNNABLE before being picked
+  uint64 rundelay[NSCHEDHIST]; // runs by log2(time RUNNABLE)
+  uint64 wakelat[NSCHEDHIST];  // runs after a wakeup, by log2(wakeup to run)
+};
+
+struct proc_sched_stat {
+  int pid;
+  char name[16];
+  struct sched_stat s;
+};
+
+// system calls, indexed by number. times are in timer cycles.
+#define NSYSCALLSTAT 32  // syscall numbers tracked
+#define NSYSHIST     24  // log2 histogram buckets; the last is open-ended
+
+struct syscall_stat {
+  uint64 count;            // calls that returned
+  uint64 cycles;           // total entry-to-return time
+  uint64 spin;             // ... spent spinning in acquire()
+  uint64 hist[NSYSHIST];   // calls by log2(cycles)
+};
+
+// virtual memory
+struct vm_stat {
+  uint64 cow_shared;  // pages fork shared instead of copying
+  uint64 cow_faults;  // writes to copy-on-write pages
+  uint64 cow_copied;  // ... that copied the page
+  uint64 cow_reused;  // ... that found it no longer shared
+  uint64 exec_pages;  // pages of program segments exec() set up
+  uint64 exec_faults; // ... that were then faulted in
+  uint64 exec_shared; // ... from the shared text page cache
+  uint64 mega_mapped; // 2 MiB megapages mapped
+  uint64 mega_demoted; // ... later split into 4 KiB pages
+  uint64 pt_pages;    // page-table pages in use now
+};
+
+// page faults of one process
+struct fault_stat {
+  uint64 lazy;        // on lazily allocated memory
+  uint64 lazy_pages;  // ... pages they mapped, with fault-around
+  uint64 cow;         // copy-on-write
+  uint64 exec;        // program pages loaded
+};
+
+struct proc_fault_stat {
+  int pid;
+  char name[16];
+  struct fault_stat f;
+};
+
+// file system
+struct fs_stat {
+  uint64 dcache_hits;   // dirlookup()s answered by the dcache
+  uint64 dcache_misses; // ... that read the directory
+  uint64 inodes;        // entries in the inode table
+  uint64 iget_hits;     // iget()s that found the inode in the table
+  uint64 iget_misses;   // ... that recycled an entry for it
+  uint64 blocks_free;   // free data blocks
+  uint64 bmap_hits;     // indirect bmap()s answered from cached runs
+  uint64 bmap_misses;   // ... that read indirect blocks
+};
+
+#endif
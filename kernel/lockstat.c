@@ -3,9 +3,10 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "defs.h"
-#include "lockstat.h"
 
 // Use the public definition from lockstat.h and expose the array used
 // internally by the kernel for tracking lock statistics.
@@ -81,6 +82,37 @@ get_lock_index(struct spinlock *lk)
     return -1;
 }
 
+// Find the current process's entry for lock class idx.
+// If it has none and create is set, take a free slot, or
+// else evict the class it has acquired least, so it keeps
+// roughly its top classes; otherwise return 0.
+// Called with interrupts off, so the process can't move.
+static struct proc_lock_stat *
+proc_lock_entry(int idx, int create)
+{
+    struct proc *p = mycpu()->proc;
+    struct proc_lock_stat *e, *victim = 0;
+
+    if(p == 0)
+        return 0;
+    for(e = p->lockstat; e < &p->lockstat[PROC_LOCK_CLASSES]; e++) {
+        if(e->class == idx)
+            return e;
+        if(victim == 0 || e->class < 0 ||
+           (victim->class >= 0 && e->acquire_count < victim->acquire_count))
+            victim = e;
+    }
+    if(!create)
+        return 0;
+    victim->class = idx;
+    mystrncpy(victim->name, lock_stats[idx].name, MAX_LOCK_NAME);
+    victim->acquire_count = 0;
+    victim->contention_count = 0;
+    victim->total_wait_time = 0;
+    victim->total_hold_time = 0;
+    return victim;
+}
+
 void 
 lockstat_record_acquire(struct spinlock *lk, uint64 wait_time) 
 {
@@ -89,6 +121,15 @@ lockstat_record_acquire(struct spinlock *lk, uint64 wait_time)
     
     int idx = get_lock_index(lk);
     if(idx < 0) return;
+
+    struct proc_lock_stat *e = proc_lock_entry(idx, 1);
+    if(e) {
+        e->acquire_count++;
+        if(wait_time > 0) {
+            e->contention_count++;
+            e->total_wait_time += wait_time;
+        }
+    }
     
     __sync_fetch_and_add(&lock_stats[idx].acquire_count, 1);
     
@@ -114,6 +155,12 @@ lockstat_record_release(struct spinlock *lk, uint64 hold_time)
     if(idx < 0) return;
     
     __sync_fetch_and_add(&lock_stats[idx].total_hold_time, hold_time);
+
+    // the releasing process may not be the one that acquired
+    // the lock (p->lock across swtch()), so don't make room.
+    struct proc_lock_stat *e = proc_lock_entry(idx, 0);
+    if(e)
+        e->total_hold_time += hold_time;
     
     // Update max hold time
     if(hold_time > lock_stats[idx].max_hold_time)
@@ -151,4 +198,27 @@ lockstat_copy_to_user(uint64 addr, int max_locks)
   }
   
   return count;
-}
\ No newline at end of file
+}
+
+// Copy the per-process lock statistics of process pid
+// to user space, at most max entries. Returns the
+// number of entries copied, or -1 if there is no such pid.
+uint64
+lockstat_proc_copy_to_user(int pid, uint64 addr, int max)
+{
+  struct proc_lock_stat st[PROC_LOCK_CLASSES];
+  struct proc *p;
+  int n = 0;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  for(int i = 0; i < PROC_LOCK_CLASSES; i++) {
+    if(p->lockstat[i].class >= 0 && n < max)
+      st[n++] = p->lockstat[i];
+  }
+  release(&p->lock);
+  if(n > 0 && copyout(myproc()->pagetable, addr, (char*)st,
+                      n * sizeof(st[0])) < 0)
+    return -1;
+  return n;
+}
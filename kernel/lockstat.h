@@ -18,6 +18,19 @@ struct lock_stat {
     int enabled;
 };
 
+#define PROC_LOCK_CLASSES 8   // lock classes tracked per process
+
+// Per-process share of one lock class (locks with the same name),
+// kept in struct proc for the classes it acquires most.
+struct proc_lock_stat {
+    char name[MAX_LOCK_NAME];
+    int class;                 // index into lock_stats[], or -1 if unused
+    uint64 acquire_count;
+    uint64 contention_count;
+    uint64 total_wait_time;    // cycles spent spinning
+    uint64 total_hold_time;    // cycles held
+};
+
 void lockstat_init(void);
 void lockstat_record_acquire(struct spinlock *lk, uint64 wait_time);
 void lockstat_record_release(struct spinlock *lk, uint64 hold_time);
@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "kstat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -19,7 +20,17 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the commit thread has taken the log.
+//
+// Commits are done by a kernel thread, the committer. When
+// the last outstanding end_op() finishes, the committer
+// copies the open transaction (log.lh and its blocks) aside
+// into log.clh and log.lbuf[], empties log.lh so that new
+// system calls can start the next transaction, and writes
+// the copy to disk. Every system call that ends while a
+// commit is in progress joins the next one (group commit).
+// FS system calls thus return before their updates are on
+// disk, but updates always reach the disk in order.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -28,7 +39,8 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// A commit writes all of its log blocks as one batch of disk
+// requests, then the header, then all home blocks as one batch.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -40,15 +52,23 @@ struct logheader {
 struct log {
   struct spinlock lock;
   int start;
+  int size;        // data blocks in the on-disk log, <= LOGBLOCKS
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
   int dev;
-  struct logheader lh;
+  struct logheader lh;           // open transaction
+  struct buf *pinned[LOGBLOCKS]; // cached buf of each block in lh
+  int ntrans;                    // FS sys calls that ended in lh
+
+  // owned by the committer once it has taken a transaction.
+  struct logheader clh;          // transaction being committed
+  struct buf *cpinned[LOGBLOCKS];
+  struct buf lbuf[LOGBLOCKS];    // copy of clh's blocks, for disk I/O
+  struct log_stat stat;
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void committer(void);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -58,29 +78,57 @@ initlog(int dev, struct superblock *sb)
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
+  log.size = sb->nlog - 1;  // header block, then data blocks
+  if(log.size > LOGBLOCKS)
+    log.size = LOGBLOCKS;
+  if(log.size < MAXOPBLOCKS)
+    panic("initlog: log too small");
+  log.stat.size = log.size;
   log.dev = dev;
   recover_from_log();
+  kproc("committer", committer);
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// log.lbuf[] holds their contents, copied there by take_trans()
+// or read back from the log by read_log().
 static void
 install_trans(int recovering)
 {
+  struct buf *bs[LOGBLOCKS];
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
+  for (tail = 0; tail < log.clh.n; tail++) {
     if(recovering) {
-      printf("recovering tail %d dst %d\n", tail, log.lh.block[tail]);
+      printf("recovering tail %d dst %d\n", tail, log.clh.block[tail]);
     }
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+    log.lbuf[tail].dev = log.dev;
+    log.lbuf[tail].blockno = log.clh.block[tail];
+    bs[tail] = &log.lbuf[tail];
+  }
+  bwritev(bs, log.clh.n);  // write all dsts to disk
+  if(recovering == 0){
+    for (tail = 0; tail < log.clh.n; tail++)
+      bunpin(log.cpinned[tail]);
+  }
+}
+
+// Read committed blocks from the log into log.lbuf[].
+// Only used by recovery, before anything but the superblock
+// is in the buffer cache, so the cache can't hold stale
+// copies of the blocks install_trans() then writes.
+static void
+read_log(void)
+{
+  struct buf *bs[LOGBLOCKS];
+  int tail;
+
+  for (tail = 0; tail < log.clh.n; tail++) {
+    log.lbuf[tail].dev = log.dev;
+    log.lbuf[tail].blockno = log.start+tail+1;
+    bs[tail] = &log.lbuf[tail];
   }
+  breadv(bs, log.clh.n);
 }
 
 // Read the log header from disk into the in-memory log header
@@ -90,9 +138,9 @@ read_head(void)
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  log.clh.n = lh->n;
+  for (i = 0; i < log.clh.n; i++) {
+    log.clh.block[i] = lh->block[i];
   }
   brelse(buf);
 }
@@ -106,9 +154,9 @@ write_head(void)
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = log.clh.n;
+  for (i = 0; i < log.clh.n; i++) {
+    hb->block[i] = log.clh.block[i];
   }
   bwrite(buf);
   brelse(buf);
@@ -118,8 +166,9 @@ static void
 recover_from_log(void)
 {
   read_head();
+  read_log();
   install_trans(1); // if committed, copy from log to disk
-  log.lh.n = 0;
+  log.clh.n = 0;
   write_head(); // clear the log
 }
 
@@ -127,14 +176,21 @@ recover_from_log(void)
 void
 begin_op(void)
 {
+  uint64 t0 = 0;
+
   acquire(&log.lock);
   while(1){
-    if(log.committing){
-      sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGBLOCKS){
-      // this op might exhaust log space; wait for commit.
+    if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > log.size){
+      // this op might exhaust log space; wait for the
+      // committer to take the open transaction.
+      if(t0 == 0){
+        t0 = r_time();
+        log.stat.waits++;
+      }
       sleep(&log, &log.lock);
     } else {
+      if(t0)
+        log.stat.wait_cycles += r_time() - t0;
       log.outstanding += 1;
       release(&log.lock);
       break;
@@ -143,19 +199,15 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// wakes the committer if this was the last outstanding operation.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
+  log.ntrans += 1;
   if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+    wakeup(&log.lh);
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
@@ -163,49 +215,100 @@ end_op(void)
     wakeup(&log);
   }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// Move the open transaction to log.clh, copying its blocks
+// from the cache into log.lbuf[], and start an empty one.
+// Caller holds log.lock and no FS system calls are active,
+// so the pinned cache blocks can't change while we copy them.
+static void
+take_trans(void)
+{
+  int tail;
+
+  for (tail = 0; tail < log.lh.n; tail++) {
+    log.clh.block[tail] = log.lh.block[tail];
+    log.cpinned[tail] = log.pinned[tail];
+    memmove(log.lbuf[tail].data, log.pinned[tail]->data, BSIZE);
   }
+  log.clh.n = log.lh.n;
+  log.lh.n = 0;
+  log.ntrans = 0;
+
+  // begin_op() may be waiting for log space.
+  wakeup(&log);
 }
 
-// Copy modified blocks from cache to log.
+// Write the blocks copied by take_trans() to the log.
 static void
 write_log(void)
 {
+  struct buf *bs[LOGBLOCKS];
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  for (tail = 0; tail < log.clh.n; tail++) {
+    struct buf *to = &log.lbuf[tail];
+    to->dev = log.dev;
+    to->blockno = log.start+tail+1; // log block
+    bs[tail] = to;
   }
+  bwritev(bs, log.clh.n);  // write the log
 }
 
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  write_log();     // Write modified blocks to log
+  write_head();    // Write header to disk -- the real commit
+  install_trans(0); // Now install writes to home locations
+  log.clh.n = 0;
+  write_head();    // Erase the transaction from the log
+}
+
+// The committer kernel thread. Waits for a quiet moment
+// with a non-empty transaction, takes it, and commits it
+// while new FS system calls fill the next one.
+static void
+committer(void)
+{
+  acquire(&log.lock);
+  for(;;){
+    while(log.outstanding > 0 || log.lh.n == 0)
+      sleep(&log.lh, &log.lock);
+
+    int ntrans = log.ntrans;
+    take_trans();
+    release(&log.lock);
+
+    uint64 t0 = r_time();
+    int n = log.clh.n;
+    commit();
+    uint64 t = r_time() - t0;
+
+    acquire(&log.lock);
+    log.stat.commits++;
+    log.stat.trans += ntrans;
+    log.stat.blocks += n;
+    if(n > log.stat.max_blocks)
+      log.stat.max_blocks = n;
+    log.stat.commit_cycles += t;
+    if(t > log.stat.max_commit_cycles)
+      log.stat.max_commit_cycles = t;
   }
 }
 
+// Copy out the logging statistics.
+void
+log_stat(struct log_stat *st)
+{
+  acquire(&log.lock);
+  *st = log.stat;
+  release(&log.lock);
+}
+
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// The committer will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -218,7 +321,7 @@ log_write(struct buf *b)
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGBLOCKS)
+  if (log.lh.n >= log.size)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -228,10 +331,13 @@ log_write(struct buf *b)
       break;
   }
   log.lh.block[i] = b->blockno;
+  log.stat.writes++;
+  if (i < log.lh.n)
+    log.stat.absorbed++;
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
+    log.pinned[i] = b;
     log.lh.n++;
   }
   release(&log.lock);
 }
-
@@ -12,7 +12,6 @@ main()
 {
   if(cpuid() == 0){
     consoleinit();
-    printfinit();
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
@@ -27,6 +26,9 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe table
+    pcacheinit();    // program text page cache
+    dcacheinit();    // directory lookup cache
     virtio_disk_init(); // emulated hard disk
     lockstat_init(); 
     userinit();      // first user process
@@ -17,6 +17,11 @@
 // end -- start of kernel page allocation area
 // PHYSTOP -- end RAM used by the kernel
 
+// core local interruptor (CLINT). a hart writes 1 to another
+// hart's msip register to raise a software interrupt there.
+#define CLINT 0x02000000L
+#define CLINT_MSIP(hart) (CLINT + 4*(hart))
+
 // qemu puts UART registers here in physical memory.
 #define UART0 0x10000000L
 #define UART0_IRQ 10
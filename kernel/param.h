@@ -2,14 +2,28 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // i-nodes cached before the inode table grows
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NEXECSEG      4  // max loadable segments per program
+#define NPCACHE     256  // pages of program text cached for sharing
+#define NMEGAPAGE    16  // 2 MiB runs of memory kept for megapages
+#define NDCACHE     256  // directory lookup cache entries
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGBLOCKS    (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define LOGBLOCKS    (MAXOPBLOCKS*6)  // max data blocks in on-disk log
+#define NREADAHEAD   8  // max blocks of sequential read-ahead per inode
+#define NBRESERVE    4  // unused bufs read-ahead leaves, per CPU, for ops in flight
+#define NBUF         (LOGBLOCKS*2+NCPU*(NREADAHEAD+NBRESERVE))  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
+#define TIMEBASE     10000000  // qemu virt timer (r_time()) frequency, Hz
+#ifndef HZ
+#define HZ           10  // default clock ticks per second; make HZ=n
+#endif
+#define MAXHZ        1000  // fastest clock tick rate tickhz() allows
+#if HZ > MAXHZ
+#error "HZ is above MAXHZ"
+#endif
 #define MAXPATH      128   // maximum file path name
 #define USERSTACK    1     // user stack pages
 
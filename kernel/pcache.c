@@ -0,0 +1,143 @@
+// Page cache for program text.
+//
+// Read-only pages of executables are loaded once and
+// shared by every process running the program: the
+// cache holds a reference to each page, and so does
+// every page table that maps it.
+//
+// Writing or truncating a file drops its pages from the
+// cache; processes already mapping them keep the old
+// contents.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;     // file offset of the page
+  uint n;       // bytes from the file; the rest are zero
+  char *pa;     // 0 if the slot is free
+  uint64 used;  // pcache.clock at last lookup
+};
+
+struct {
+  struct spinlock lock;
+  struct pcpage page[NPCACHE];
+  uint64 clock;
+} pcache;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+// find a cached page. called with pcache.lock held.
+static struct pcpage*
+pcache_find(struct inode *ip, uint off, uint n)
+{
+  struct pcpage *pg;
+
+  for(pg = pcache.page; pg < &pcache.page[NPCACHE]; pg++)
+    if(pg->pa && pg->dev == ip->dev && pg->inum == ip->inum &&
+       pg->off == off && pg->n == n)
+      return pg;
+  return 0;
+}
+
+// Return a page holding n bytes of ip at offset off
+// followed by zeros, with a reference for the caller,
+// reading it from ip if it is not cached. Locks ip
+// unless the caller already holds it.
+// Returns 0 on error.
+char*
+pcache_get(struct inode *ip, uint off, uint n)
+{
+  struct pcpage *pg, *victim;
+  char *mem;
+  int held;
+
+  acquire(&pcache.lock);
+  if((pg = pcache_find(ip, off, n)) != 0){
+    pg->used = ++pcache.clock;
+    kref(pg->pa);
+    release(&pcache.lock);
+    return pg->pa;
+  }
+  release(&pcache.lock);
+
+  // read the page with ip locked, so that pcache_inval()
+  // cannot run between the read and the insert.
+  held = holdingsleep(&ip->lock);
+  if(!held)
+    ilock(ip);
+  if((mem = kalloc()) == 0)
+    goto out;
+  memset(mem, 0, PGSIZE);
+  if(readi(ip, 0, (uint64)mem, off, n) != n){
+    kfree(mem);
+    mem = 0;
+    goto out;
+  }
+
+  acquire(&pcache.lock);
+  if((pg = pcache_find(ip, off, n)) != 0){
+    // another process loaded it meanwhile.
+    kfree(mem);
+    mem = pg->pa;
+  } else {
+    victim = pcache.page;
+    for(pg = pcache.page; pg < &pcache.page[NPCACHE]; pg++){
+      if(pg->pa == 0){
+        victim = pg;
+        break;
+      }
+      if(pg->used < victim->used)
+        victim = pg;
+    }
+    pg = victim;
+    if(pg->pa)
+      kfree(pg->pa);
+    pg->dev = ip->dev;
+    pg->inum = ip->inum;
+    pg->off = off;
+    pg->n = n;
+    pg->pa = mem;
+    ip->pcached = 1;
+  }
+  pg->used = ++pcache.clock;
+  kref(mem);
+  release(&pcache.lock);
+
+ out:
+  if(!held)
+    iunlock(ip);
+  return mem;
+}
+
+// Drop ip's pages from the cache, because its
+// contents are changing. Caller must hold ip->lock.
+void
+pcache_inval(struct inode *ip)
+{
+  struct pcpage *pg;
+
+  if(ip->pcached == 0)
+    return;
+  acquire(&pcache.lock);
+  for(pg = pcache.page; pg < &pcache.page[NPCACHE]; pg++){
+    if(pg->pa && pg->dev == ip->dev && pg->inum == ip->inum){
+      kfree(pg->pa);
+      pg->pa = 0;
+    }
+  }
+  release(&pcache.lock);
+  ip->pcached = 0;
+}
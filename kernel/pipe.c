@@ -3,22 +3,74 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+// the ring lives in PIPEPAGES separate pages so that
+// a reader or writer can move up to a page per copy.
+#define PIPEPAGES 2
+#define PIPESIZE (PIPEPAGES*PGSIZE)
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *data[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rwait;      // a reader is asleep on nread
+  int wwait;      // a writer is asleep on nwrite
+  int used;       // allocated; protected by pipes.lock
 };
 
+// every pipe holds two files, so there can't be more
+// than NFILE/2 of them.
+#define NPIPE (NFILE/2)
+
+struct {
+  struct spinlock lock;
+  struct pipe pipe[NPIPE];
+} pipes;
+
+void
+pipeinit(void)
+{
+  initlock(&pipes.lock, "pipes");
+}
+
+static struct pipe*
+pipeget(void)
+{
+  struct pipe *pi;
+
+  acquire(&pipes.lock);
+  for(pi = pipes.pipe; pi < pipes.pipe + NPIPE; pi++){
+    if(pi->used == 0){
+      memset(pi, 0, sizeof(*pi));
+      pi->used = 1;
+      release(&pipes.lock);
+      return pi;
+    }
+  }
+  release(&pipes.lock);
+  return 0;
+}
+
+static void
+pipefree(struct pipe *pi)
+{
+  for(int i = 0; i < PIPEPAGES; i++)
+    if(pi->data[i])
+      kfree(pi->data[i]);
+  acquire(&pipes.lock);
+  pi->used = 0;
+  release(&pipes.lock);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,8 +80,11 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = pipeget()) == 0)
     goto bad;
+  for(int i = 0; i < PIPEPAGES; i++)
+    if((pi->data[i] = kalloc()) == 0)
+      goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
@@ -47,7 +102,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    pipefree(pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,15 +123,47 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    pipefree(pi);
   } else
     release(&pi->lock);
 }
 
+// wake a sleeping reader. called with pi->lock held.
+static void
+pipewakereader(struct pipe *pi)
+{
+  if(pi->rwait){
+    pi->rwait = 0;
+    wakeup(&pi->nread);
+  }
+}
+
+// wake a sleeping writer once at least half the ring
+// is free, so that it can refill in large copies.
+// called with pi->lock held.
+static void
+pipewakewriter(struct pipe *pi)
+{
+  if(pi->wwait && pi->nwrite - pi->nread <= PIPESIZE/2){
+    pi->wwait = 0;
+    wakeup(&pi->nwrite);
+  }
+}
+
+// length of the contiguous ring segment starting at
+// offset off, clipped to n bytes.
+static uint
+pipeseg(uint off, uint n)
+{
+  uint m = PGSIZE - off % PGSIZE;
+  return m < n ? m : n;
+}
+
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
   int i = 0;
+  uint m, off;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
@@ -86,17 +173,26 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       return -1;
     }
     if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
+      pipewakereader(pi);
+      pi->wwait = 1;
       sleep(&pi->nwrite, &pi->lock);
     } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+      off = pi->nwrite % PIPESIZE;
+      m = pipeseg(off, PIPESIZE - (pi->nwrite - pi->nread));
+      if(m > n - i)
+        m = n - i;
+      if(copyin(pr->pagetable, pi->data[off / PGSIZE] + off % PGSIZE, addr + i, m) == -1)
         break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      // let a sleeping reader start draining once the
+      // ring passes half full, rather than after each copy.
+      if(pi->nwrite - pi->nread < PIPESIZE/2 &&
+         pi->nwrite + m - pi->nread >= PIPESIZE/2)
+        pipewakereader(pi);
+      pi->nwrite += m;
+      i += m;
     }
   }
-  wakeup(&pi->nread);
+  pipewakereader(pi);
   release(&pi->lock);
 
   return i;
@@ -106,8 +202,8 @@ int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
   int i;
+  uint m, off;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -115,20 +211,24 @@ piperead(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
+    pi->rwait = 1;
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
+  for(i = 0; i < n; i += m){  //DOC: piperead-copy
     if(pi->nread == pi->nwrite)
       break;
-    ch = pi->data[pi->nread % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1) {
+    off = pi->nread % PIPESIZE;
+    m = pipeseg(off, pi->nwrite - pi->nread);
+    if(m > n - i)
+      m = n - i;
+    if(copyout(pr->pagetable, addr + i, pi->data[off / PGSIZE] + off % PGSIZE, m) == -1) {
       if(i == 0)
         i = -1;
       break;
     }
-    pi->nread++;
+    pi->nread += m;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  pipewakewriter(pi);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
 }
@@ -13,18 +13,134 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "defs.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 
 volatile int panicking = 0; // printing a panic message
 volatile int panicked = 0; // spinning forever at end of a panic
 
-// lock to avoid interleaving concurrent printf's.
+// kernel output ring. printf() and consputc() copy bytes in
+// without locks; the uart driver takes them out and feeds them
+// to the uart, from its transmit interrupt or when a producer
+// kicks it. producers reserve space by advancing reserved with
+// a compare-and-swap, copy their bytes in, and then publish
+// them by advancing committed, in reservation order.
+// the counters only grow; positions are taken mod KLOGSIZE.
+#define KLOGSIZE 4096  // power of two
 static struct {
-  struct spinlock lock;
-} pr;
+  char buf[KLOGSIZE];
+  uint64 reserved;    // bytes claimed by producers
+  uint64 committed;   // bytes copied in, available to the uart
+  uint64 consumed;    // bytes taken by the uart
+} klog;
+
+// per-CPU buffers in which printf() formats its output, so
+// that each printf() reaches the ring as one piece unless it
+// is longer than PBUFSIZE.
+#define PBUFSIZE 256
+static struct {
+  char buf[PBUFSIZE];
+  int n;
+} pbufs[NCPU];
 
 static char digits[] = "0123456789abcdef";
 
+// append n <= KLOGSIZE bytes to the output ring.
+// interrupts must be off, so that nothing else runs
+// on this CPU between reserving and committing.
+static void
+klog_put(char *s, int n)
+{
+  uint64 start;
+
+  for(;;){
+    start = __atomic_load_n(&klog.reserved, __ATOMIC_RELAXED);
+    if(start + n - __atomic_load_n(&klog.consumed, __ATOMIC_ACQUIRE) > KLOGSIZE){
+      // full: push some bytes out to the uart ourselves.
+      uartdrain(1);
+      continue;
+    }
+    if(__sync_bool_compare_and_swap(&klog.reserved, start, start + n))
+      break;
+  }
+
+  for(int i = 0; i < n; i++)
+    klog.buf[(start + i) & (KLOGSIZE-1)] = s[i];
+
+  // wait for earlier reservations to be committed.
+  while(__atomic_load_n(&klog.committed, __ATOMIC_ACQUIRE) != start)
+    ;
+  __atomic_store_n(&klog.committed, start + n, __ATOMIC_RELEASE);
+
+  uartdrain(0);
+}
+
+// are there bytes in the ring for the uart?
+int
+klog_pending(void)
+{
+  return __atomic_load_n(&klog.committed, __ATOMIC_ACQUIRE) !=
+    __atomic_load_n(&klog.consumed, __ATOMIC_RELAXED);
+}
+
+// take up to max bytes out of the ring.
+// only one CPU at a time may call this; see uartdrain().
+int
+klog_take(char *dst, int max)
+{
+  uint64 c = __atomic_load_n(&klog.consumed, __ATOMIC_RELAXED);
+  uint64 n = __atomic_load_n(&klog.committed, __ATOMIC_ACQUIRE) - c;
+
+  if(n > max)
+    n = max;
+  for(int i = 0; i < n; i++)
+    dst[i] = klog.buf[(c + i) & (KLOGSIZE-1)];
+  __atomic_store_n(&klog.consumed, c + n, __ATOMIC_RELEASE);
+  return n;
+}
+
+// write bytes to the console through the output ring.
+void
+klog_write(char *s, int n)
+{
+  push_off();
+  while(n > 0){
+    int m = n < PBUFSIZE ? n : PBUFSIZE;
+    klog_put(s, m);
+    s += m;
+    n -= m;
+  }
+  pop_off();
+}
+
+// move this CPU's printf buffer into the output ring.
+static void
+pflush(void)
+{
+  int id = cpuid();
+
+  if(pbufs[id].n > 0)
+    klog_put(pbufs[id].buf, pbufs[id].n);
+  pbufs[id].n = 0;
+}
+
+// output one character of printf().
+// interrupts must be off.
+static void
+pputc(int c)
+{
+  if(panicking){
+    uartputc_sync(c);
+    return;
+  }
+
+  int id = cpuid();
+  pbufs[id].buf[pbufs[id].n++] = c;
+  if(pbufs[id].n == PBUFSIZE)
+    pflush();
+}
+
 static void
 printint(long long xx, int base, int sign)
 {
@@ -46,17 +162,17 @@ printint(long long xx, int base, int sign)
     buf[i++] = '-';
 
   while(--i >= 0)
-    consputc(buf[i]);
+    pputc(buf[i]);
 }
 
 static void
 printptr(uint64 x)
 {
   int i;
-  consputc('0');
-  consputc('x');
+  pputc('0');
+  pputc('x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+    pputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the console.
@@ -67,13 +183,14 @@ printf(char *fmt, ...)
   int i, cx, c0, c1, c2;
   char *s;
 
-  if(panicking == 0)
-    acquire(&pr.lock);
+  // stay on this CPU, and keep interrupt handlers'
+  // printf()s out of our buffer.
+  push_off();
 
   va_start(ap, fmt);
   for(i = 0; (cx = fmt[i] & 0xff) != 0; i++){
     if(cx != '%'){
-      consputc(cx);
+      pputc(cx);
       continue;
     }
     i++;
@@ -108,27 +225,28 @@ printf(char *fmt, ...)
     } else if(c0 == 'p'){
       printptr(va_arg(ap, uint64));
     } else if(c0 == 'c'){
-      consputc(va_arg(ap, uint));
+      pputc(va_arg(ap, uint));
     } else if(c0 == 's'){
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
       for(; *s; s++)
-        consputc(*s);
+        pputc(*s);
     } else if(c0 == '%'){
-      consputc('%');
+      pputc('%');
     } else if(c0 == 0){
       break;
     } else {
       // Print unknown % sequence to draw attention.
-      consputc('%');
-      consputc(c0);
+      pputc('%');
+      pputc(c0);
     }
 
   }
   va_end(ap);
 
   if(panicking == 0)
-    release(&pr.lock);
+    pflush();
+  pop_off();
 
   return 0;
 }
@@ -136,16 +254,15 @@ printf(char *fmt, ...)
 void
 panic(char *s)
 {
+  // from here on printf() writes synchronously. first try to
+  // get out what is already in the ring; give up if another
+  // CPU holds the uart and never lets go.
   panicking = 1;
+  for(int i = 0; i < KLOGSIZE && klog_pending(); i++)
+    uartdrain(1);
   printf("panic: ");
   printf("%s\n", s);
   panicked = 1; // freeze uart output from other CPUs
   for(;;)
     ;
 }
-
-void
-printfinit(void)
-{
-  initlock(&pr.lock, "pr");
-}
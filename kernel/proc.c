@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "defs.h"
 
@@ -12,11 +14,39 @@ struct proc proc[NPROC];
 
 struct proc *initproc;
 
+// Per-CPU queues of RUNNABLE processes. A process is on
+// at most one queue, and only while it is RUNNABLE.
+// Lock order: p->lock, then a run queue's lock.
+struct runq {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc *tail;
+};
+struct runq runqs[NCPU];
+int nrunnable;  // processes on all run queues
+
+struct sched_stat schedstat;  // whole system; updated atomically
+
+// Hash table of processes sleeping in sleep(), keyed
+// by wait channel. A process is on the queue of its
+// p->chan exactly while it is SLEEPING.
+// Lock order: condition lock, then a wait queue's lock,
+// then p->lock.
+#define WAITQSHIFT 6
+#define NWAITQ (1 << WAITQSHIFT)
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+};
+struct waitq waitqs[NWAITQ];
+
 int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void kprocstart(void);
 static void freeproc(struct proc *p);
+static void makerunnable(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -51,6 +81,10 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runqs[i].lock, "runq");
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitqs[i].lock, "waitq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
@@ -124,6 +158,15 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->woken = 0;
+  memset(&p->sched, 0, sizeof(p->sched));
+  memset(&p->faults, 0, sizeof(p->faults));
+  p->fanext = 0;
+  p->fawin = 0;
+  for(int i = 0; i < PROC_LOCK_CLASSES; i++){
+    memset(&p->lockstat[i], 0, sizeof(p->lockstat[i]));
+    p->lockstat[i].class = -1;
+  }
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -162,9 +205,11 @@ freeproc(struct proc *p)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
+  p->nseg = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
+  p->kfn = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
@@ -226,7 +271,7 @@ userinit(void)
   
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  makerunnable(p);
 
   release(&p->lock);
 }
@@ -248,7 +293,9 @@ growproc(int n)
       return -1;
     }
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    if((sz = uvmdealloc(p->pagetable, sz, sz + n)) == p->sz)
+      return -1;
+    execshrink(p, sz);
   }
   p->sz = sz;
   return 0;
@@ -287,6 +334,10 @@ kfork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  if(p->exe)
+    np->exe = exedup(p->exe);
+  memmove(np->segs, p->segs, sizeof(p->segs));
+  np->nseg = p->nseg;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -299,12 +350,32 @@ kfork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  np->cpu = p->cpu;
+  makerunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
+// Start a kernel thread that runs fn(), which must never return.
+// A kernel thread has no user memory and never leaves the kernel;
+// it can sleep() like any process.
+void
+kproc(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kproc");
+
+  p->kfn = fn;
+  p->context.ra = (uint64)kprocstart;
+  safestrcpy(p->name, name, sizeof(p->name));
+  makerunnable(p);
+
+  release(&p->lock);
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
@@ -342,8 +413,12 @@ kexit(int status)
 
   begin_op();
   iput(p->cwd);
+  if(p->exe)
+    exeput(p->exe);
   end_op();
   p->cwd = 0;
+  p->exe = 0;
+  p->nseg = 0;
 
   acquire(&wait_lock);
 
@@ -374,6 +449,8 @@ kwait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  if(addr != 0)
+    execprefault(addr, sizeof(int));
   acquire(&wait_lock);
 
   for(;;){
@@ -414,10 +491,116 @@ kwait(uint64 addr)
   }
 }
 
+// Append RUNNABLE p to the run queue of the
+// CPU it last ran on. Caller must hold p->lock.
+static void
+runq_push(struct proc *p)
+{
+  struct runq *rq = &runqs[p->cpu];
+
+  p->rqtime = r_time();
+  acquire(&rq->lock);
+  p->rqnext = 0;
+  if(rq->tail)
+    rq->tail->rqnext = p;
+  else
+    rq->head = p;
+  rq->tail = p;
+  release(&rq->lock);
+  __sync_fetch_and_add(&nrunnable, 1);
+}
+
+// Wake an idle hart to run a newly queued process,
+// preferring the one whose queue it is on.
+static void
+kickidle(int id)
+{
+  // pairs with the fence in scheduler(): either we see
+  // the hart's idle flag, or it sees nrunnable > 0.
+  __sync_synchronize();
+
+  if(cpus[id].idle){
+    ipi(id);
+    return;
+  }
+  for(int i = 0; i < NCPU; i++){
+    if(cpus[i].idle){
+      ipi(i);
+      return;
+    }
+  }
+}
+
+// Mark p RUNNABLE, queue it, and wake an idle hart
+// to run it. Caller must hold p->lock.
+static void
+makerunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  runq_push(p);
+  kickidle(p->cpu);
+}
+
+// log2 histogram bucket for a time of d cycles.
+static int
+schedbucket(uint64 d)
+{
+  int b = 0;
+
+  while(d > 1 && b < NSCHEDHIST-1){
+    d >>= 1;
+    b++;
+  }
+  return b;
+}
+
+// Account for scheduler() picking p. Caller holds p->lock.
+static void
+schedrun(struct proc *p)
+{
+  uint64 d = r_time() - p->rqtime;
+  int b = schedbucket(d);
+
+  p->sched.runs++;
+  p->sched.delay += d;
+  p->sched.rundelay[b]++;
+  __sync_fetch_and_add(&schedstat.runs, 1);
+  __sync_fetch_and_add(&schedstat.delay, d);
+  __sync_fetch_and_add(&schedstat.rundelay[b], 1);
+  if(p->woken){
+    p->sched.wakelat[b]++;
+    __sync_fetch_and_add(&schedstat.wakelat[b], 1);
+  }
+}
+
+// Take the first process off rq, or return 0 if rq is empty.
+// The caller must acquire its p->lock before running it.
+static struct proc*
+runq_pop(struct runq *rq)
+{
+  struct proc *p;
+
+  // an unlocked peek keeps idle harts off the queue locks.
+  if(__atomic_load_n(&rq->head, __ATOMIC_RELAXED) == 0)
+    return 0;
+
+  acquire(&rq->lock);
+  if((p = rq->head) != 0){
+    rq->head = p->rqnext;
+    if(rq->head == 0)
+      rq->tail = 0;
+    p->rqnext = 0;
+    __sync_fetch_and_sub(&nrunnable, 1);
+  }
+  release(&rq->lock);
+  return p;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - take a process off this CPU's run queue, or
+//    steal one from another CPU's if it is empty.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -426,6 +609,7 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
 
   c->proc = 0;
   for(;;){
@@ -437,28 +621,43 @@ scheduler(void)
     intr_on();
     intr_off();
 
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-        found = 1;
+    p = 0;
+    if(__atomic_load_n(&nrunnable, __ATOMIC_RELAXED) > 0){
+      p = runq_pop(&runqs[id]);
+      // nothing to run here; steal from the other CPUs.
+      for(int i = 1; p == 0 && i < NCPU; i++)
+        p = runq_pop(&runqs[(id + i) % NCPU]);
+    }
+    if(p == 0) {
+      // nothing to run; stop running on this core until an
+      // interrupt. makerunnable() sends an ipi to idle harts.
+      c->idle = 1;
+      __sync_synchronize();
+      if(__atomic_load_n(&nrunnable, __ATOMIC_RELAXED) == 0){
+        clockidle();
+        asm volatile("wfi");
+        clockbusy();
       }
-      release(&p->lock);
+      c->idle = 0;
+      continue;
     }
-    if(found == 0) {
-      // nothing to run; stop running on this core until an interrupt.
-      asm volatile("wfi");
+
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      schedrun(p);
+      p->state = RUNNING;
+      p->cpu = id;
+      c->proc = p;
+      swtch(&c->context, &p->context);
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
     }
+    release(&p->lock);
   }
 }
 
@@ -495,7 +694,13 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
+  // this CPU is about to pick a process, so
+  // don't wake an idle hart for this one.
   p->state = RUNNABLE;
+  p->woken = 0;
+  p->sched.nivcsw++;
+  __sync_fetch_and_add(&schedstat.nivcsw, 1);
+  runq_push(p);
   sched();
   release(&p->lock);
 }
@@ -537,26 +742,55 @@ forkret(void)
   ((void (*)(uint64))trampoline_userret)(satp);
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kprocstart.
+static void
+kprocstart(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn();
+  panic("kproc returned");
+}
+
+// The wait queue for channel chan.
+static struct waitq*
+waitq(void *chan)
+{
+  uint64 h = (uint64)chan * 0x9E3779B97F4A7C15ULL;
+  return &waitqs[h >> (64 - WAITQSHIFT)];
+}
+
 // Sleep on channel chan, releasing condition lock lk.
 // Re-acquires lk when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = waitq(chan);
   
-  // Must acquire p->lock in order to
-  // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
+  // Must acquire the wait queue's lock and p->lock in
+  // order to queue p, change p->state, and then call sched.
+  // Once p is queued, we can be guaranteed that we won't
+  // miss any wakeup (wakeup locks the queue), so it's okay
+  // to release lk.
 
+  acquire(&wq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
-  release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->wqnext = wq->head;
+  wq->head = p;
+  p->sched.nvcsw++;
+  __sync_fetch_and_add(&schedstat.nvcsw, 1);
+
+  release(&wq->lock);
+  release(lk);
 
   sched();
 
@@ -573,17 +807,66 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct waitq *wq = waitq(chan);
+  struct proc *p, **pp;
+
+  // sleep() queues a process before releasing the condition
+  // lock, so an empty queue here means nobody to wake.
+  if(__atomic_load_n(&wq->head, __ATOMIC_RELAXED) == 0)
+    return;
+
+  acquire(&wq->lock);
+  for(pp = &wq->head; (p = *pp) != 0; ){
+    if(p->chan == chan){
+      *pp = p->wqnext;
+      p->wqnext = 0;
+      acquire(&p->lock);
+      p->woken = 1;
+      makerunnable(p);
+      release(&p->lock);
+    } else {
+      pp = &p->wqnext;
+    }
+  }
+  release(&wq->lock);
+}
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
+// Wake p if it is still sleeping on chan.
+static void
+wakeproc(struct proc *p, void *chan)
+{
+  struct waitq *wq = waitq(chan);
+  struct proc **pp;
+
+  acquire(&wq->lock);
+  for(pp = &wq->head; *pp != 0; pp = &(*pp)->wqnext){
+    if(*pp == p && p->chan == chan){
+      *pp = p->wqnext;
+      p->wqnext = 0;
       acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
+      p->woken = 1;
+      makerunnable(p);
       release(&p->lock);
+      break;
     }
   }
+  release(&wq->lock);
+}
+
+// Find the process with the given pid.
+// Returns it with p->lock held, or 0 if there is none.
+struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state != UNUSED && p->pid == pid)
+      return p;
+    release(&p->lock);
+  }
+  return 0;
 }
 
 // Kill the process with the given pid.
@@ -598,11 +881,12 @@ kkill(int pid)
     acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
+      void *chan = p->state == SLEEPING ? p->chan : 0;
       release(&p->lock);
+      // Wake process from sleep(). The wait queue's
+      // lock comes before p->lock, so drop p->lock first.
+      if(chan)
+        wakeproc(p, chan);
       return 0;
     }
     release(&p->lock);
@@ -659,6 +943,67 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
   }
 }
 
+// Copy out the system-wide scheduling statistics.
+void
+sched_stat(struct sched_stat *st)
+{
+  *st = schedstat;
+}
+
+// Copy a struct proc_sched_stat for each process to user
+// address addr, filling at most n bytes. Returns the number
+// of bytes copied.
+int
+procsched_copy_to_user(uint64 addr, int n)
+{
+  struct proc_sched_stat ps;
+  struct proc *p;
+  int off = 0;
+
+  for(p = proc; p < &proc[NPROC] && off + sizeof(ps) <= n; p++){
+    acquire(&p->lock);
+    if(p->state == UNUSED){
+      release(&p->lock);
+      continue;
+    }
+    ps.pid = p->pid;
+    safestrcpy(ps.name, p->name, sizeof(ps.name));
+    ps.s = p->sched;
+    release(&p->lock);
+    if(copyout(myproc()->pagetable, addr + off, (char *)&ps, sizeof(ps)) < 0)
+      return -1;
+    off += sizeof(ps);
+  }
+  return off;
+}
+
+// Copy a struct proc_fault_stat for each process to user
+// address addr, filling at most n bytes. Returns the number
+// of bytes copied.
+int
+procfault_copy_to_user(uint64 addr, int n)
+{
+  struct proc_fault_stat ps;
+  struct proc *p;
+  int off = 0;
+
+  for(p = proc; p < &proc[NPROC] && off + sizeof(ps) <= n; p++){
+    acquire(&p->lock);
+    if(p->state == UNUSED){
+      release(&p->lock);
+      continue;
+    }
+    ps.pid = p->pid;
+    safestrcpy(ps.name, p->name, sizeof(ps.name));
+    ps.f = p->faults;
+    release(&p->lock);
+    if(copyout(myproc()->pagetable, addr + off, (char *)&ps, sizeof(ps)) < 0)
+      return -1;
+    off += sizeof(ps);
+  }
+  return off;
+}
+
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
@@ -24,6 +24,7 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int idle;                   // In scheduler()'s wfi; wake with ipi().
 };
 
 extern struct cpu cpus[NCPU];
@@ -79,6 +80,16 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// a loadable program segment, faulted in from p->exe
+// by execfault() on first touch.
+struct execseg {
+  uint64 va;      // page-aligned start
+  uint64 memsz;   // bytes in memory
+  uint64 filesz;  // ... of which come from the file
+  uint off;       // file offset of va
+  int perm;       // PTE_X and PTE_W
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -91,6 +102,18 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // CPU it last ran on, whose run queue it joins
+  uint64 rqtime;               // when it last became RUNNABLE
+  int woken;                   // ... by wakeup() or kkill()
+  struct sched_stat sched;     // scheduling statistics
+  struct proc_lock_stat lockstat[PROC_LOCK_CLASSES]; // updated only while p runs
+  uint64 spin_cycles;          // total time spinning in acquire(), ditto
+
+  // the lock of the run queue p is on protects this:
+  struct proc *rqnext;         // next process on the run queue
+
+  // p->chan and this are also protected by p->chan's wait queue lock:
+  struct proc *wqnext;         // next process sleeping in the wait queue
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -103,5 +126,12 @@ struct proc {
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct inode *exe;           // Program file, for demand paging
+  struct execseg segs[NEXECSEG]; // its loadable segments
+  int nseg;
+  struct fault_stat faults;    // page-fault counts
+  uint64 fanext;               // va just past the last fault-around window
+  int fawin;                   // ... and its size, in pages
   char name[16];               // Process name (debugging)
+  void (*kfn)(void);           // body of a kernel thread, see kproc()
 };
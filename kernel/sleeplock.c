@@ -6,6 +6,8 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "sleeplock.h"
 
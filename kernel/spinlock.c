@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "defs.h"
 
@@ -50,6 +52,8 @@ acquire(struct spinlock *lk)
   lk->acquire_time = end_time; // store the acquire timestamp
   
   // Record statistics
+  if(wait_time > 0 && lk->cpu->proc)
+    lk->cpu->proc->spin_cycles += wait_time;
   lockstat_record_acquire(lk, wait_time); // ← Track statistics
 }
 
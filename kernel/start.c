@@ -6,10 +6,15 @@
 
 void main();
 void timerinit();
+void ipiinit();
+extern void msoftvec();
 
 // entry.S needs one stack per CPU.
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
+// scratch area for msoftvec, two words per CPU.
+uint64 mscratch0[NCPU * 2];
+
 // entry.S jumps here in machine mode on stack0.
 void
 start()
@@ -30,7 +35,7 @@ start()
   // delegate all interrupts and exceptions to supervisor mode.
   w_medeleg(0xffff);
   w_mideleg(0xffff);
-  w_sie(r_sie() | SIE_SEIE | SIE_STIE);
+  w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
 
   // configure Physical Memory Protection to give supervisor mode
   // access to all of physical memory.
@@ -40,6 +45,9 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // take inter-processor interrupts.
+  ipiinit();
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -62,5 +70,19 @@ timerinit()
   w_mcounteren(r_mcounteren() | 2);
   
   // ask for the very first timer interrupt.
-  w_stimecmp(r_time() + 1000000);
+  w_stimecmp(r_time() + TIMEBASE / HZ);
+}
+
+// let other harts interrupt this one with ipi().
+// the CLINT raises a machine-mode software interrupt,
+// which can't be delegated; msoftvec in kernelvec.S
+// turns it into a supervisor software interrupt.
+void
+ipiinit()
+{
+  int id = r_mhartid();
+
+  w_mscratch((uint64)&mscratch0[id * 2]);
+  w_mtvec((uint64)msoftvec);
+  w_mie(r_mie() | MIE_MSIE);
 }
@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
@@ -102,6 +104,11 @@ extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
 extern uint64 sys_lockstat(void);
+extern uint64 sys_kstat(void);
+extern uint64 sys_tickhz(void);
+extern uint64 sys_plockstat(void);
+extern uint64 sys_megapages(void);
+extern uint64 sys_faultaround(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -128,8 +135,64 @@ static uint64 (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_lockstat] sys_lockstat,
+[SYS_kstat]   sys_kstat,
+[SYS_tickhz]  sys_tickhz,
+[SYS_plockstat] sys_plockstat,
+[SYS_megapages] sys_megapages,
+[SYS_faultaround] sys_faultaround,
 };
 
+// per-CPU system call statistics, written only by their
+// own CPU with interrupts off.
+struct syscall_stat sysstats[NCPU][NSYSCALLSTAT];
+
+// Account a call to syscall num that took t cycles,
+// spin of them spinning on locks.
+static void
+syscall_record(int num, uint64 t, uint64 spin)
+{
+  int b = 0;
+
+  if(num >= NSYSCALLSTAT)
+    return;
+  for(uint64 d = t; d > 1 && b < NSYSHIST-1; d >>= 1)
+    b++;
+
+  push_off();
+  struct syscall_stat *st = &sysstats[cpuid()][num];
+  st->count++;
+  st->cycles += t;
+  st->spin += spin;
+  st->hist[b]++;
+  pop_off();
+}
+
+// Copy a struct syscall_stat per syscall number, summed
+// over CPUs, to user address addr, filling at most n bytes.
+// Returns the number of bytes copied.
+int
+syscall_stat_copy_to_user(uint64 addr, int n)
+{
+  struct syscall_stat sum;
+  int off = 0;
+
+  for(int num = 0; num < NSYSCALLSTAT && off + sizeof(sum) <= n; num++){
+    memset(&sum, 0, sizeof(sum));
+    for(int c = 0; c < NCPU; c++){
+      struct syscall_stat *st = &sysstats[c][num];
+      sum.count += st->count;
+      sum.cycles += st->cycles;
+      sum.spin += st->spin;
+      for(int b = 0; b < NSYSHIST; b++)
+        sum.hist[b] += st->hist[b];
+    }
+    if(copyout(myproc()->pagetable, addr + off, (char *)&sum, sizeof(sum)) < 0)
+      return -1;
+    off += sizeof(sum);
+  }
+  return off;
+}
+
 void
 syscall(void)
 {
@@ -138,9 +201,12 @@ syscall(void)
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    uint64 t0 = r_time();
+    uint64 spin0 = p->spin_cycles;
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
     p->trapframe->a0 = syscalls[num]();
+    syscall_record(num, r_time() - t0, p->spin_cycles - spin0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
@@ -21,3 +21,8 @@
 #define SYS_mkdir  20
 #define SYS_close  21
 #define SYS_lockstat 22
+#define SYS_kstat  23
+#define SYS_tickhz 24
+#define SYS_plockstat 25
+#define SYS_megapages 26
+#define SYS_faultaround 27
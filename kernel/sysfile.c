@@ -10,6 +10,8 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
@@ -341,6 +343,13 @@ sys_open(void)
     return -1;
   }
 
+  // a program being run can't be changed; see exedup().
+  if(ip->running && (omode & (O_WRONLY|O_RDWR|O_TRUNC))){
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
+
   if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
     if(f)
       fileclose(f);
@@ -361,7 +370,7 @@ sys_open(void)
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
-    itrunc(ip);
+    itrunc(ip);  // can't fail; checked ip->running above
   }
 
   iunlock(ip);
@@ -4,6 +4,8 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "vm.h"
 
@@ -68,22 +70,11 @@ uint64
 sys_pause(void)
 {
   int n;
-  uint ticks0;
 
   argint(0, &n);
   if(n < 0)
     n = 0;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(killed(myproc())){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return kpause(n);
 }
 
 uint64
@@ -100,12 +91,18 @@ sys_kill(void)
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  return kuptime();
+}
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+// set the clock tick rate, if the argument is positive,
+// and return the previous one.
+uint64
+sys_tickhz(void)
+{
+  int hz;
+
+  argint(0, &hz);
+  return ktickhz(hz);
 }
 
 // THÊM syscall mới
@@ -120,3 +117,50 @@ sys_lockstat(void)
   
   return lockstat_copy_to_user(addr, max_locks);
 }
+
+// per-process lock statistics of the given pid
+uint64
+sys_plockstat(void)
+{
+  int pid, max;
+  uint64 addr;
+
+  argint(0, &pid);
+  argaddr(1, &addr);
+  argint(2, &max);
+
+  return lockstat_proc_copy_to_user(pid, addr, max);
+}
+
+// turn megapage mappings on or off; -1 just asks
+uint64
+sys_megapages(void)
+{
+  int on;
+
+  argint(0, &on);
+  return kmegapages(on);
+}
+
+// set the lazy fault-around window; 0 just asks
+uint64
+sys_faultaround(void)
+{
+  int n;
+
+  argint(0, &n);
+  return kfaultaround(n);
+}
+
+uint64
+sys_kstat(void)
+{
+  int kind, n;
+  uint64 addr;
+
+  argint(0, &kind);
+  argaddr(1, &addr);
+  argint(2, &n);
+
+  return kstat_copy_to_user(kind, addr, n);
+}
@@ -3,12 +3,26 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "defs.h"
 
 struct spinlock tickslock;
 uint ticks;
 
+// tickslock must be held when using these:
+uint64 tickcycles;   // timer cycles per tick
+uint64 nexttick;     // when ticks next advances
+
+// processes in kpause(), as a min-heap on deadline.
+struct pauser {
+  uint deadline;     // tick to wake at
+  void *chan;        // wait channel
+};
+struct pauser pausers[NPROC];
+int npausers;
+
 extern char trampoline[], uservec[];
 
 // in kernelvec.S, calls kerneltrap().
@@ -20,6 +34,8 @@ void
 trapinit(void)
 {
   initlock(&tickslock, "time");
+  tickcycles = TIMEBASE / HZ;
+  nexttick = r_time() + tickcycles;
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -68,9 +84,18 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
-  } else if((r_scause() == 15 || r_scause() == 13) &&
-            vmfault(p->pagetable, r_stval(), (r_scause() == 13)? 1 : 0) != 0) {
-    // page fault on lazily-allocated page
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    // page fault on a lazily-allocated, copy-on-write, or
+    // not yet loaded program page. loading may sleep, so
+    // allow interrupts once the trap registers are read.
+    uint64 scause = r_scause();
+    uint64 va = r_stval();
+    intr_on();
+    if(vmfault(p->pagetable, va, scause != 15) == 0){
+      printf("usertrap(): unexpected scause 0x%lx pid=%d\n", scause, p->pid);
+      printf("            sepc=0x%lx stval=0x%lx\n", p->trapframe->epc, va);
+      setkilled(p);
+    }
   } else {
     printf("usertrap(): unexpected scause 0x%lx pid=%d\n", r_scause(), p->pid);
     printf("            sepc=0x%lx stval=0x%lx\n", r_sepc(), r_stval());
@@ -161,20 +186,190 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// is tick a before tick b? works across wrap-around.
+static int
+tickbefore(uint a, uint b)
+{
+  return (int)(a - b) < 0;
+}
+
+static void
+pswap(int i, int j)
+{
+  struct pauser t = pausers[i];
+  pausers[i] = pausers[j];
+  pausers[j] = t;
+}
+
+// remove pausers[i] from the heap.
+static void
+pdelete(int i)
+{
+  npausers--;
+  if(i == npausers)
+    return;
+  pausers[i] = pausers[npausers];
+  // sift up, then down.
+  while(i > 0 && tickbefore(pausers[i].deadline, pausers[(i-1)/2].deadline)){
+    pswap(i, (i-1)/2);
+    i = (i-1)/2;
+  }
+  for(;;){
+    int m = i, l = 2*i+1, r = 2*i+2;
+    if(l < npausers && tickbefore(pausers[l].deadline, pausers[m].deadline))
+      m = l;
+    if(r < npausers && tickbefore(pausers[r].deadline, pausers[m].deadline))
+      m = r;
+    if(m == i)
+      break;
+    pswap(i, m);
+    i = m;
+  }
+}
+
+static void
+pinsert(uint deadline, void *chan)
+{
+  int i = npausers++;
+
+  if(npausers > NPROC)
+    panic("pinsert");
+  pausers[i].deadline = deadline;
+  pausers[i].chan = chan;
+  while(i > 0 && tickbefore(pausers[i].deadline, pausers[(i-1)/2].deadline)){
+    pswap(i, (i-1)/2);
+    i = (i-1)/2;
+  }
+}
+
+// bring ticks up to date, which may be behind if hart 0
+// idled with its timer off, and wake expired pausers.
+// caller must hold tickslock.
+static void
+tickupdate(void)
+{
+  uint64 now = r_time();
+
+  if(now >= nexttick){
+    uint64 n = (now - nexttick) / tickcycles + 1;
+    ticks += n;
+    nexttick += n * tickcycles;
+  }
+  while(npausers > 0 && !tickbefore(ticks, pausers[0].deadline)){
+    wakeup(pausers[0].chan);
+    pdelete(0);
+  }
+}
+
+// Sleep for n clock ticks. Returns -1 if killed.
+int
+kpause(int n)
+{
+  uint ticks0;   // its address is our wait channel
+
+  acquire(&tickslock);
+  tickupdate();
+  ticks0 = ticks;
+  while(ticks - ticks0 < n){
+    if(killed(myproc())){
+      release(&tickslock);
+      return -1;
+    }
+    pinsert(ticks0 + n, &ticks0);
+    // an idle hart 0 may have turned its timer off,
+    // or set it for a later deadline; see clockidle().
+    __sync_synchronize();
+    if(cpus[0].idle)
+      ipi(0);
+    sleep(&ticks0, &tickslock);
+    // still queued if woken by kill().
+    for(int i = 0; i < npausers; i++){
+      if(pausers[i].chan == &ticks0){
+        pdelete(i);
+        break;
+      }
+    }
+    tickupdate();
+  }
+  release(&tickslock);
+  return 0;
+}
+
+// current tick count.
+uint
+kuptime(void)
+{
+  uint xticks;
+
+  acquire(&tickslock);
+  tickupdate();
+  xticks = ticks;
+  release(&tickslock);
+  return xticks;
+}
+
+// set the clock tick rate to hz, if hz > 0.
+// returns the previous rate, or -1 if hz is above MAXHZ.
+// deadlines of sleeping kpause()s are in ticks, so they
+// now pass faster or slower in real time.
+int
+ktickhz(int hz)
+{
+  int old;
+
+  if(hz > MAXHZ)
+    return -1;
+  acquire(&tickslock);
+  tickupdate();
+  old = TIMEBASE / tickcycles;
+  if(hz > 0){
+    tickcycles = TIMEBASE / hz;
+    nexttick = r_time() + tickcycles;
+  }
+  release(&tickslock);
+  return old;
+}
+
+// a timer interrupt. hart 0 keeps time; every hart
+// that is running a process takes periodic interrupts
+// so that it can preempt it.
 void
 clockintr()
 {
   if(cpuid() == 0){
     acquire(&tickslock);
-    ticks++;
-    wakeup(&ticks);
+    tickupdate();
     release(&tickslock);
   }
 
   // ask for the next timer interrupt. this also clears
-  // the interrupt request. 1000000 is about a tenth
-  // of a second.
-  w_stimecmp(r_time() + 1000000);
+  // the interrupt request.
+  w_stimecmp(r_time() + tickcycles);
+}
+
+// program this hart's timer before it idles in wfi.
+// other harts need no timer interrupts while idle;
+// hart 0 needs one only at the next kpause() deadline.
+void
+clockidle(void)
+{
+  uint64 when = -1;  // never
+
+  if(cpuid() == 0){
+    acquire(&tickslock);
+    tickupdate();
+    if(npausers > 0)
+      when = nexttick + (uint64)(pausers[0].deadline - ticks - 1) * tickcycles;
+    release(&tickslock);
+  }
+  w_stimecmp(when);
+}
+
+// restart periodic timer interrupts after clockidle().
+void
+clockbusy(void)
+{
+  w_stimecmp(r_time() + tickcycles);
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -207,6 +402,12 @@ devintr()
     if(irq)
       plic_complete(irq);
 
+    return 1;
+  } else if(scause == 0x8000000000000001L){
+    // software interrupt from another hart's ipi(),
+    // passed on by msoftvec in kernelvec.S. all it
+    // does is wake this hart from wfi.
+    w_sip(r_sip() & ~SIP_SSIP);
     return 1;
   } else if(scause == 0x8000000000000005L){
     // timer interrupt.
@@ -217,3 +418,9 @@ devintr()
   }
 }
 
+// interrupt hart, e.g. to wake it from wfi.
+void
+ipi(int hart)
+{
+  *(volatile uint32 *)CLINT_MSIP(hart) = 1;
+}
@@ -7,6 +7,8 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "defs.h"
 
@@ -37,10 +39,20 @@
 #define LSR_RX_READY (1<<0)   // input is waiting to be read from RHR
 #define LSR_TX_IDLE (1<<5)    // THR can accept another character to send
 
-// for sending threads to synchronize with uart "ready" interrupts.
+#define TX_FIFO 16            // depth of the transmit FIFO
+
+// set while a CPU is feeding the transmit FIFO; see uartdrain().
+static int tx_owner;
+
+// transmit ring for write() system calls. uartwrite() fills it
+// under tx_lock, and whoever feeds the FIFO empties it, so each
+// end has one user at a time. the indices only grow.
+#define TX_BUF_SIZE 512       // power of two
 static struct spinlock tx_lock;
-static int tx_busy;           // is the UART busy sending?
-static int tx_chan;           // &tx_chan is the "wait channel"
+static char tx_buf[TX_BUF_SIZE];
+static uint tx_w;             // written by uartwrite()
+static uint tx_r;             // read by uartdrain()
+static int tx_waiting;        // a writer sleeps on &tx_r for space
 
 extern volatile int panicking; // from printf.c
 extern volatile int panicked; // from printf.c
@@ -73,34 +85,100 @@ uartinit(void)
   initlock(&tx_lock, "uart");
 }
 
-// transmit buf[] to the uart. it blocks if the
-// uart is busy, so it cannot be called from
-// interrupts, only from write() system calls.
+// transmit buf[] to the uart. it copies as much as fits
+// into the transmit ring and sleeps if the ring is full,
+// so it cannot be called from interrupts, only from write()
+// system calls.
 void
 uartwrite(char buf[], int n)
 {
   acquire(&tx_lock);
 
   int i = 0;
-  while(i < n){ 
-    while(tx_busy != 0){
-      // wait for a UART transmit-complete interrupt
-      // to set tx_busy to 0.
-      sleep(&tx_chan, &tx_lock);
-    }   
-      
-    WriteReg(THR, buf[i]);
-    i += 1;
-    tx_busy = 1;
+  while(i < n){
+    uint r = __atomic_load_n(&tx_r, __ATOMIC_ACQUIRE);
+    int m = TX_BUF_SIZE - (tx_w - r);
+    if(m == 0){
+      // wait for uartintr() to make room.
+      tx_waiting = 1;
+      sleep(&tx_r, &tx_lock);
+      continue;
+    }
+    if(m > n - i)
+      m = n - i;
+    for(int j = 0; j < m; j++)
+      tx_buf[(tx_w + j) & (TX_BUF_SIZE-1)] = buf[i + j];
+    __atomic_store_n(&tx_w, tx_w + m, __ATOMIC_RELEASE);
+    i += m;
+    uartdrain(0);
   }
 
   release(&tx_lock);
 }
 
+// are there write() bytes waiting for the uart?
+static int
+tx_pending(void)
+{
+  return __atomic_load_n(&tx_w, __ATOMIC_ACQUIRE) != tx_r;
+}
+
+// fill buf with up to max bytes from the kernel output
+// ring, which goes first, and then the transmit ring.
+static int
+tx_take(char *buf, int max)
+{
+  int n = klog_take(buf, max);
+  uint w = __atomic_load_n(&tx_w, __ATOMIC_ACQUIRE);
+
+  while(n < max && tx_r != w){
+    buf[n++] = tx_buf[tx_r & (TX_BUF_SIZE-1)];
+    tx_r++;
+  }
+  __atomic_store_n(&tx_r, tx_r, __ATOMIC_RELEASE);
+  return n;
+}
+
+// move bytes from the kernel output ring and the transmit
+// ring into the transmit FIFO, if it is empty. if poll is set, wait for it to
+// empty first; otherwise the transmit interrupt that
+// comes when it does calls this again.
+// only one CPU feeds the FIFO at a time; others return
+// at once and leave their bytes to it.
+void
+uartdrain(int poll)
+{
+  char buf[TX_FIFO];
+
+  for(;;){
+    if(__sync_lock_test_and_set(&tx_owner, 1) != 0)
+      return;
+
+    if(poll){
+      while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+        ;
+    }
+    if(ReadReg(LSR) & LSR_TX_IDLE){
+      int n = tx_take(buf, TX_FIFO);
+      for(int i = 0; i < n; i++)
+        WriteReg(THR, buf[i]);
+    }
+
+    __sync_lock_release(&tx_owner);
+    __sync_synchronize();
+
+    // a producer may have committed bytes and given up
+    // while we owned the FIFO. if the FIFO is busy, its
+    // interrupt will pick them up; otherwise go again.
+    if(!(klog_pending() || tx_pending()) || (ReadReg(LSR) & LSR_TX_IDLE) == 0)
+      return;
+  }
+}
+
 
 // write a byte to the uart without using
-// interrupts, for use by kernel printf() and
-// to echo characters. it spins waiting for the uart's
+// interrupts or the output ring, for use by
+// panic(). it spins waiting for the uart's
 // output register to be empty.
 void
 uartputc_sync(int c)
@@ -143,13 +221,21 @@ uartintr(void)
 {
   ReadReg(ISR); // acknowledge the interrupt
 
-  acquire(&tx_lock);
-  if(ReadReg(LSR) & LSR_TX_IDLE){
-    // UART finished transmitting; wake up sending thread.
-    tx_busy = 0;
-    wakeup(&tx_chan);
+  // send more output, if the transmit FIFO has emptied.
+  uartdrain(0);
+
+  // wake writers once half the transmit ring is free,
+  // rather than for every byte. a writer that sets
+  // tx_waiting after the peek has left the ring full,
+  // so more transmit interrupts will follow.
+  if(__atomic_load_n(&tx_waiting, __ATOMIC_RELAXED)){
+    acquire(&tx_lock);
+    if(tx_waiting && tx_w - tx_r <= TX_BUF_SIZE/2){
+      tx_waiting = 0;
+      wakeup(&tx_r);
+    }
+    release(&tx_lock);
   }
-  release(&tx_lock);
 
   // read and process incoming characters, if any.
   while(1){
@@ -46,8 +46,10 @@
 #define VIRTIO_RING_F_EVENT_IDX     29
 
 // this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// must be a power of two, and no more than qemu's
+// virtio-blk queue size (256). each request uses three,
+// so about 40 requests can be in flight at once.
+#define NUM 128
 
 // a single descriptor, from the spec.
 struct virtq_desc {
@@ -74,8 +76,10 @@ struct virtq_used_elem {
   uint32 len;
 };
 
+#define VRING_USED_F_NO_NOTIFY 1 // device doesn't need QUEUE_NOTIFY writes
+
 struct virtq_used {
-  uint16 flags; // always zero
+  uint16 flags; // VRING_USED_F_NO_NOTIFY, set by the device
   uint16 idx;   // device increments when it adds a ring[] entry
   struct virtq_used_elem ring[NUM];
 };
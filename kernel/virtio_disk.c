@@ -41,6 +41,7 @@ static struct disk {
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
   uint16 used_idx; // we've looked this far in used[2..NUM].
+  int unkicked;    // avail entries the device hasn't been told about.
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
@@ -48,6 +49,7 @@ static struct disk {
   struct {
     struct buf *b;
     char status;
+    void (*done)(struct buf *); // if set, called instead of waking a waiter.
   } info[NUM];
 
   // disk command headers.
@@ -212,12 +214,31 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// tell the device about new avail ring entries, unless
+// it has said it will find them without a notification.
+// caller must hold disk.vdisk_lock.
+static void
+virtio_disk_kick(void)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  if(disk.unkicked == 0)
+    return;
+  disk.unkicked = 0;
 
-  acquire(&disk.vdisk_lock);
+  __sync_synchronize();
+
+  if((disk.used->flags & VRING_USED_F_NO_NOTIFY) == 0)
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
+
+// format a request for b and add it to the avail ring,
+// without notifying the device; see virtio_disk_kick().
+// caller must hold disk.vdisk_lock.
+// if nowait is set and no descriptors are free, returns -1
+// instead of sleeping until some are.
+static int
+virtio_disk_start(struct buf *b, int write, void (*done)(struct buf *), int nowait)
+{
+  uint64 sector = b->blockno * (BSIZE / 512);
 
   // the spec's Section 5.2 says that legacy block operations use
   // three descriptors: one for type/reserved/sector, one for the
@@ -229,6 +250,11 @@ virtio_disk_rw(struct buf *b, int write)
     if(alloc3_desc(idx) == 0) {
       break;
     }
+    if(nowait)
+      return -1;
+    // requests queued by this batch must reach the device,
+    // or nothing will ever free descriptors.
+    virtio_disk_kick();
     sleep(&disk.free[0], &disk.vdisk_lock);
   }
 
@@ -267,6 +293,7 @@ virtio_disk_rw(struct buf *b, int write)
   // record struct buf for virtio_disk_intr().
   b->disk = 1;
   disk.info[idx[0]].b = b;
+  disk.info[idx[0]].done = done;
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -275,20 +302,61 @@ virtio_disk_rw(struct buf *b, int write)
 
   // tell the device another avail ring entry is available.
   disk.avail->idx += 1; // not % NUM ...
+  disk.unkicked += 1;
 
-  __sync_synchronize();
+  return 0;
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// queue disk requests for n bufs, all reads or all writes,
+// and notify the device once for the whole batch.
+// sleeps only if the descriptor ring fills up.
+// if done is non-zero, virtio_disk_intr() calls done(b) as
+// each request finishes; otherwise the caller must wait
+// for the bufs with virtio_disk_wait().
+void
+virtio_disk_submit(struct buf **bufs, int n, int write, void (*done)(struct buf *))
+{
+  acquire(&disk.vdisk_lock);
+  for(int i = 0; i < n; i++)
+    virtio_disk_start(bufs[i], write, done, 0);
+  virtio_disk_kick();
+  release(&disk.vdisk_lock);
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+// wait for the requests of n bufs queued by
+// virtio_disk_submit() without a done function.
+void
+virtio_disk_wait(struct buf **bufs, int n)
+{
+  acquire(&disk.vdisk_lock);
+  for(int i = 0; i < n; i++){
+    // Wait for virtio_disk_intr() to say request has finished.
+    while(bufs[i]->disk == 1)
+      sleep(bufs[i], &disk.vdisk_lock);
   }
+  release(&disk.vdisk_lock);
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(&b, 1, write, 0);
+  virtio_disk_wait(&b, 1);
+}
+
+// start reading b from disk, but don't wait for it.
+// virtio_disk_intr() calls done(b) when the data has arrived.
+// never sleeps; returns -1 if the descriptor ring is full.
+int
+virtio_disk_read_async(struct buf *b, void (*done)(struct buf *))
+{
+  int r;
 
+  acquire(&disk.vdisk_lock);
+  if((r = virtio_disk_start(b, 0, done, 1)) == 0)
+    virtio_disk_kick();
   release(&disk.vdisk_lock);
+  return r;
 }
 
 void
@@ -317,10 +385,22 @@ virtio_disk_intr()
       panic("virtio_disk_intr status");
 
     struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
-
+    void (*done)(struct buf *) = disk.info[id].done;
+    disk.info[id].b = 0;
+    free_chain(id);
     disk.used_idx += 1;
+
+    b->disk = 0;   // disk is done with buf
+    if(done){
+      // asynchronous request: nobody is waiting in
+      // virtio_disk_wait(). call the completion routine
+      // without holding the disk lock.
+      release(&disk.vdisk_lock);
+      done(b);
+      acquire(&disk.vdisk_lock);
+    } else {
+      wakeup(b);
+    }
   }
 
   release(&disk.vdisk_lock);
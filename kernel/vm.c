@@ -5,6 +5,8 @@
 #include "riscv.h"
 #include "defs.h"
 #include "spinlock.h"
+#include "kstat.h"
+#include "lockstat.h"
 #include "proc.h"
 #include "fs.h"
 
@@ -17,6 +19,22 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+struct vm_stat vmstat;
+
+// map user memory with 2 MiB megapages where possible.
+// see kmegapages().
+int megapages = 1;
+
+#define VMBATCH 32  // pages uvmalloc() and uvmunmap() handle at a time
+
+// most pages vmfault() maps at once in lazily allocated
+// memory touched in order. see kfaultaround().
+int faultaround = 16;
+
+static pte_t *walklevel(pagetable_t, uint64, int, int);
+static int demote(pte_t *);
+static uint64 lazyfault(struct proc *, pagetable_t, uint64);
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -29,6 +47,9 @@ kvmmake(void)
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT msip registers, for ipi()
+  kvmmap(kpgtbl, CLINT, CLINT, PGSIZE, PTE_R | PTE_W);
+
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
@@ -94,14 +115,29 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// A megapage met on the way down is split into 4 KiB
+// pages if alloc!=0; otherwise walk() returns 0 for it.
+// Use walkleaf() to look up a mapping of either size.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, alloc, 0);
+}
+
+// walk() down to the PTE at the given level (0 or 1).
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int alloc, int tolevel)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
+  for(int level = 2; level > tolevel; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
+    if((*pte & PTE_V) && PTE_LEAF(*pte)){
+      if(!alloc || demote(pte) < 0)
+        return 0;
+    }
     if(*pte & PTE_V) {
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
@@ -109,11 +145,57 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
         return 0;
       memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
+      __sync_fetch_and_add(&vmstat.pt_pages, 1);
+    }
+  }
+  return &pagetable[PX(tolevel, va)];
+}
+
+// Return the leaf PTE that maps va, a 4 KiB one or a
+// megapage one, and set *level to 0 or 1 accordingly.
+// Returns 0 if there is no page table for va at all.
+// Never changes the page table.
+pte_t *
+walkleaf(pagetable_t pagetable, uint64 va, int *level)
+{
+  if(va >= MAXVA)
+    panic("walkleaf");
+
+  for(int l = 2; l > 0; l--) {
+    pte_t *pte = &pagetable[PX(l, va)];
+    if((*pte & PTE_V) == 0)
+      return 0;
+    if(PTE_LEAF(*pte)){
+      *level = l;
+      return pte;
     }
+    pagetable = (pagetable_t)PTE2PA(*pte);
   }
+  *level = 0;
   return &pagetable[PX(0, va)];
 }
 
+// Split the megapage mapped by the level-1 PTE *pte into
+// a leaf page table of 4 KiB PTEs with the same flags.
+// Each of its pages already holds its own reference, so
+// nothing else changes. Returns -1 if out of memory.
+static int
+demote(pte_t *pte)
+{
+  pagetable_t t;
+  uint64 pa = PTE2PA(*pte);
+  uint flags = PTE_FLAGS(*pte);
+
+  if((t = (pagetable_t)kalloc()) == 0)
+    return -1;
+  for(int i = 0; i < 512; i++)
+    t[i] = PA2PTE(pa + i*PGSIZE) | flags;
+  *pte = PA2PTE(t) | PTE_V;
+  __sync_fetch_and_add(&vmstat.pt_pages, 1);
+  __sync_fetch_and_add(&vmstat.mega_demoted, 1);
+  return 0;
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -122,11 +204,12 @@ walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   uint64 pa;
+  int level;
 
   if(va >= MAXVA)
     return 0;
 
-  pte = walk(pagetable, va, 0);
+  pte = walkleaf(pagetable, va, &level);
   if(pte == 0)
     return 0;
   if((*pte & PTE_V) == 0)
@@ -134,6 +217,8 @@ walkaddr(pagetable_t pagetable, uint64 va)
   if((*pte & PTE_U) == 0)
     return 0;
   pa = PTE2PA(*pte);
+  if(level == 1)
+    pa += PGROUNDDOWN(va) & (MEGASIZE-1);
   return pa;
 }
 
@@ -162,15 +247,19 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   for(;;){
     if((pte = walk(pagetable, a, 1)) == 0)
       return -1;
-    if(*pte & PTE_V)
-      panic("mappages: remap");
-    *pte = PA2PTE(pa) | perm | PTE_V;
-    if(a == last)
-      break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    // fill the rest of this leaf page table without
+    // walking down from the root again.
+    do {
+      if(*pte & PTE_V)
+        panic("mappages: remap");
+      *pte = PA2PTE(pa) | perm | PTE_V;
+      if(a == last)
+        return 0;
+      a += PGSIZE;
+      pa += PGSIZE;
+      pte++;
+    } while(PX(0, a) != 0);
   }
-  return 0;
 }
 
 // create an empty user page table.
@@ -183,32 +272,113 @@ uvmcreate()
   if(pagetable == 0)
     return 0;
   memset(pagetable, 0, PGSIZE);
+  __sync_fetch_and_add(&vmstat.pt_pages, 1);
   return pagetable;
 }
 
+// Split the megapage that maps the page at a, if there
+// is one and [va, end) doesn't cover all of it.
+// Returns -1 if out of memory.
+static int
+unmapsplit(pagetable_t pagetable, uint64 a, uint64 va, uint64 end)
+{
+  int level;
+
+  if(walkleaf(pagetable, a, &level) == 0 || level != 1)
+    return 0;
+  if(MEGAROUNDDOWN(a) >= va && MEGAROUNDDOWN(a) + MEGASIZE <= end)
+    return 0;
+  return walk(pagetable, a, 1) ? 0 : -1;
+}
+
 // Remove npages of mappings starting from va. va must be
 // page-aligned. It's OK if the mappings don't exist.
 // Optionally free the physical memory.
-void
+// Returns -1, having removed nothing, if a megapage only
+// partly in the range can't be split for lack of memory.
+int
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end, pa;
   pte_t *pte;
+  void *freed[VMBATCH];
+  int nfreed = 0, level;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0) // leaf page table entry allocated?
-      continue;   
-    if((*pte & PTE_V) == 0)  // has physical page been allocated?
+  end = va + npages*PGSIZE;
+  if(npages == 0)
+    return 0;
+  // only the megapages at the ends can be partly unmapped;
+  // split them before changing anything else.
+  if(unmapsplit(pagetable, va, va, end) < 0 ||
+     unmapsplit(pagetable, end - PGSIZE, va, end) < 0)
+    return -1;
+
+  a = va;
+  while(a < end){
+    if((pte = walkleaf(pagetable, a, &level)) == 0){ // leaf page table allocated?
+      // no: skip everything it would have mapped.
+      a = MEGAROUNDDOWN(a) + MEGASIZE;
       continue;
-    if(do_free){
-      uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
     }
-    *pte = 0;
+    if(level == 1){
+      if(a % MEGASIZE == 0 && end - a >= MEGASIZE){
+        // the whole megapage goes.
+        for(pa = PTE2PA(*pte); do_free && pa < PTE2PA(*pte) + MEGASIZE; pa += PGSIZE){
+          freed[nfreed++] = (void*)pa;
+          if(nfreed == VMBATCH){
+            kfree_n(freed, nfreed);
+            nfreed = 0;
+          }
+        }
+        *pte = 0;
+        a += MEGASIZE;
+        continue;
+      }
+      panic("uvmunmap: partial megapage");
+    }
+    // clear the rest of this leaf page table.
+    do {
+      if(*pte & PTE_V){  // has physical page been allocated?
+        if(do_free){
+          freed[nfreed++] = (void*)PTE2PA(*pte);
+          if(nfreed == VMBATCH){
+            kfree_n(freed, nfreed);
+            nfreed = 0;
+          }
+        }
+        *pte = 0;
+      }
+      a += PGSIZE;
+      pte++;
+    } while(a < end && PX(0, a) != 0);
   }
+  kfree_n(freed, nfreed);
+  return 0;
+}
+
+// Map a zeroed megapage at va, which must be aligned to
+// MEGASIZE, if megapages are enabled and nothing is
+// mapped in its range yet. Returns its physical address,
+// or 0 if it did not map one.
+static uint64
+uvmmega(pagetable_t pagetable, uint64 va, int xperm)
+{
+  pte_t *pte;
+  char *mem;
+
+  if(!megapages)
+    return 0;
+  if((pte = walklevel(pagetable, va, 1, 1)) == 0 || (*pte & PTE_V))
+    return 0;
+  if((mem = kalloc_mega()) == 0)
+    return 0;
+  memset(mem, 0, MEGASIZE);
+  *pte = PA2PTE(mem) | PTE_R | PTE_U | xperm | PTE_V;
+  __sync_fetch_and_add(&vmstat.mega_mapped, 1);
+  return (uint64)mem;
 }
 
 // Allocate PTEs and physical memory to grow a process from oldsz to
@@ -216,25 +386,39 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 uint64
 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 {
-  char *mem;
-  uint64 a;
+  char *mem[VMBATCH];
+  uint64 a, n, got;
+  pte_t *pte;
 
   if(newsz < oldsz)
     return oldsz;
 
   oldsz = PGROUNDUP(oldsz);
-  for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
-    if(mem == 0){
-      uvmdealloc(pagetable, a, oldsz);
-      return 0;
+  for(a = oldsz; a < newsz; a += n*PGSIZE){
+    // a whole aligned megapage, if it fits.
+    if(a % MEGASIZE == 0 && PGROUNDUP(newsz) - a >= MEGASIZE &&
+       uvmmega(pagetable, a, xperm) != 0){
+      n = MEGASIZE / PGSIZE;
+      continue;
     }
-    memset(mem, 0, PGSIZE);
-    if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
-      kfree(mem);
+    // a batch of pages, all in the same leaf page table.
+    n = (PGROUNDUP(newsz) - a) / PGSIZE;
+    if(n > VMBATCH)
+      n = VMBATCH;
+    if(n > 512 - PX(0, a))
+      n = 512 - PX(0, a);
+    if((got = kalloc_n((void**)mem, n)) < n ||
+       (pte = walk(pagetable, a, 1)) == 0){
+      kfree_n((void**)mem, got);
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
+    for(int i = 0; i < n; i++){
+      memset(mem[i], 0, PGSIZE);
+      if(pte[i] & PTE_V)
+        panic("uvmalloc: remap");
+      pte[i] = PA2PTE(mem[i]) | PTE_R | PTE_U | xperm | PTE_V;
+    }
   }
   return newsz;
 }
@@ -242,7 +426,8 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Returns the new process size, or oldsz if
+// out of memory for splitting a megapage.
 uint64
 uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
@@ -251,7 +436,8 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
-    uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
+    if(uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1) < 0)
+      return oldsz;
   }
 
   return newsz;
@@ -275,6 +461,7 @@ freewalk(pagetable_t pagetable)
     }
   }
   kfree((void*)pagetable);
+  __sync_fetch_and_sub(&vmstat.pt_pages, 1);
 }
 
 // Free user memory pages,
@@ -287,34 +474,47 @@ uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Given a parent process's page table, share
+// its memory with a child's page table.
+// Copies the page table, but not the physical
+// memory: writable pages become read-only and
+// copy-on-write in both, and are copied by
+// cowfault() on the first write.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
-  uint64 pa, i;
+  pte_t *pte, *npte;
+  uint64 pa, i, a;
   uint flags;
-  char *mem;
+  int level;
 
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
+    if((pte = walkleaf(old, i, &level)) == 0)
       continue;   // page table entry hasn't been allocated
     if((*pte & PTE_V) == 0)
       continue;   // physical page hasn't been allocated
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
-      goto err;
+    if(level == 1){
+      // share the megapage as a whole; a write
+      // splits it and copies just one page.
+      if((npte = walklevel(new, i, 1, 1)) == 0)
+        goto err;
+      *npte = PA2PTE(pa) | flags;
+      for(a = pa; a < pa + MEGASIZE; a += PGSIZE)
+        kref((void*)a);
+      __sync_fetch_and_add(&vmstat.cow_shared, MEGASIZE/PGSIZE);
+      i += MEGASIZE - PGSIZE;
+      continue;
     }
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
+      goto err;
+    kref((void*)pa);
+    __sync_fetch_and_add(&vmstat.cow_shared, 1);
   }
   return 0;
 
@@ -323,6 +523,47 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return -1;
 }
 
+// give the page mapped by a copy-on-write pte its own
+// writable copy, or just make it writable if nothing
+// else shares it any more.
+// returns the physical address, or 0 if out of memory.
+static uint64
+cowfault(pte_t *pte)
+{
+  uint64 pa = PTE2PA(*pte);
+  uint flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  char *mem;
+
+  __sync_fetch_and_add(&vmstat.cow_faults, 1);
+  // only this page table holds a reference, and it
+  // cannot be shared again while we run.
+  if(krefcnt((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+    __sync_fetch_and_add(&vmstat.cow_reused, 1);
+    return pa;
+  }
+  if((mem = kalloc()) == 0)
+    return 0;
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  kfree((void*)pa);
+  __sync_fetch_and_add(&vmstat.cow_copied, 1);
+  return (uint64)mem;
+}
+
+// cowfault() the page at va, splitting a megapage
+// around it first. returns 0 if out of memory.
+static uint64
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+
+  if((pte = walk(pagetable, va, 1)) == 0)
+    return 0;
+  myproc()->faults.cow++;
+  return cowfault(pte);
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -336,6 +577,40 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Find the physical address of the user page at va0 for
+// copyin(), copyout() or copyinstr(), with a single walk
+// when it is already mapped, and fault it in if not. If
+// write, a copy-on-write page gets its own copy, and
+// read-only pages are refused.
+// Returns 0 if the page cannot be accessed.
+static uint64
+uvmcopypage(pagetable_t pagetable, uint64 va0, int write)
+{
+  pte_t *pte;
+  uint64 pa;
+  int level;
+
+  if(va0 >= MAXVA)
+    return 0;
+  pte = walkleaf(pagetable, va0, &level);
+  if(pte == 0 || (*pte & PTE_V) == 0){
+    if((pa = vmfault(pagetable, va0, !write)) == 0 || !write)
+      return pa;
+    pte = walkleaf(pagetable, va0, &level);
+  }
+  if((*pte & PTE_U) == 0)
+    return 0;
+  if(write && (*pte & PTE_COW))
+    return uvmcow(pagetable, va0);
+  // forbid copyout over read-only user text pages.
+  if(write && (*pte & PTE_W) == 0)
+    return 0;
+  pa = PTE2PA(*pte);
+  if(level == 1)
+    pa += va0 & (MEGASIZE-1);
+  return pa;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -343,25 +618,12 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
-  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    if(va0 >= MAXVA)
+    if((pa0 = uvmcopypage(pagetable, va0, 1)) == 0)
       return -1;
-  
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0) {
-      if((pa0 = vmfault(pagetable, va0, 0)) == 0) {
-        return -1;
-      }
-    }
 
-    pte = walk(pagetable, va0, 0);
-    // forbid copyout over read-only user text pages.
-    if((*pte & PTE_W) == 0)
-      return -1;
-      
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -384,12 +646,8 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0) {
-      if((pa0 = vmfault(pagetable, va0, 0)) == 0) {
-        return -1;
-      }
-    }
+    if((pa0 = uvmcopypage(pagetable, va0, 0)) == 0)
+      return -1;
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
@@ -414,8 +672,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pa0 = uvmcopypage(pagetable, va0, 0)) == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
     if(n > max)
@@ -446,36 +703,92 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 }
 
 // allocate and map user memory if process is referencing a page
-// that was lazily allocated in sys_sbrk().
+// that was lazily allocated in sys_sbrk() or not yet loaded by
+// exec(), or copy a copy-on-write page that the process is writing.
 // returns 0 if va is invalid or already mapped, or if
 // out of physical memory, and physical address if successful.
 uint64
 vmfault(pagetable_t pagetable, uint64 va, int read)
 {
-  uint64 mem;
+  uint64 mem, a;
+  pte_t *pte;
+  int level;
   struct proc *p = myproc();
 
   if (va >= p->sz)
     return 0;
   va = PGROUNDDOWN(va);
-  if(ismapped(pagetable, va)) {
+  if((pte = walkleaf(pagetable, va, &level)) != 0 && (*pte & PTE_V)){
+    if(read == 0 && (*pte & PTE_COW))
+      return uvmcow(pagetable, va);
     return 0;
   }
-  mem = (uint64) kalloc();
-  if(mem == 0)
+  switch(execfault(pagetable, va, &mem)){
+  case 1:
+    return mem;
+  case -1:
+    return 0;  // program page that couldn't be loaded
+  }
+  // a whole megapage, if the lazily allocated memory
+  // covers one and no page of it is mapped yet.
+  a = MEGAROUNDDOWN(va);
+  if(a + MEGASIZE <= p->sz && !execoverlaps(a, MEGASIZE) &&
+     (mem = uvmmega(pagetable, a, PTE_W)) != 0){
+    p->faults.lazy++;
+    p->faults.lazy_pages += MEGASIZE / PGSIZE;
+    return mem + (va - a);
+  }
+  return lazyfault(p, pagetable, va);
+}
+
+// Map zeroed pages for a fault at va in lazily allocated
+// memory, starting with the page at va. A fault where the
+// previous one's window ended looks like a sequential scan,
+// so the window doubles, up to faultaround pages; any
+// other fault maps just one page.
+// Returns the physical address for va, or 0.
+static uint64
+lazyfault(struct proc *p, pagetable_t pagetable, uint64 va)
+{
+  char *mem[VMBATCH];
+  pte_t *pte;
+  int w, n;
+
+  if(execoverlaps(va, PGSIZE))
+    panic("lazyfault: program segment");
+  w = 1;
+  if(va == p->fanext)
+    w = p->fawin * 2 < faultaround ? p->fawin * 2 : faultaround;
+  // stay below p->sz, in this leaf page table, and out of
+  // mapped pages and program segments.
+  if(w > (PGROUNDUP(p->sz) - va) / PGSIZE)
+    w = (PGROUNDUP(p->sz) - va) / PGSIZE;
+  if(w > 512 - PX(0, va))
+    w = 512 - PX(0, va);
+  if((pte = walk(pagetable, va, 1)) == 0)
     return 0;
-  memset((void *) mem, 0, PGSIZE);
-  if (mappages(p->pagetable, va, PGSIZE, mem, PTE_W|PTE_U|PTE_R) != 0) {
-    kfree((void *)mem);
+  for(n = 1; n < w; n++)
+    if((pte[n] & PTE_V) || execoverlaps(va + n*PGSIZE, PGSIZE))
+      break;
+
+  if((n = kalloc_n((void**)mem, n)) == 0)
     return 0;
+  for(int i = 0; i < n; i++){
+    memset(mem[i], 0, PGSIZE);
+    pte[i] = PA2PTE(mem[i]) | PTE_W | PTE_U | PTE_R | PTE_V;
   }
-  return mem;
+  p->fanext = va + n*PGSIZE;
+  p->fawin = n;
+  p->faults.lazy++;
+  p->faults.lazy_pages += n;
+  return (uint64)mem[0];
 }
 
 int
 ismapped(pagetable_t pagetable, uint64 va)
 {
-  pte_t *pte = walk(pagetable, va, 0);
+  int level;
+  pte_t *pte = walkleaf(pagetable, va, &level);
   if (pte == 0) {
     return 0;
   }
@@ -484,3 +797,34 @@ ismapped(pagetable_t pagetable, uint64 va)
   }
   return 0;
 }
+
+void
+vm_stat(struct vm_stat *st)
+{
+  *st = vmstat;
+}
+
+// enable (1) or disable (0) megapage mappings for memory
+// allocated from now on, if on >= 0.
+// returns the previous setting.
+int
+kmegapages(int on)
+{
+  int old = megapages;
+
+  if(on >= 0)
+    megapages = on != 0;
+  return old;
+}
+
+// set the most pages a lazy fault maps to n, if n > 0;
+// 1 turns fault-around off. returns the previous value.
+int
+kfaultaround(int n)
+{
+  int old = faultaround;
+
+  if(n > 0)
+    faultaround = n < VMBATCH ? n : VMBATCH;
+  return old;
+}
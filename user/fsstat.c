@@ -0,0 +1,61 @@
+#include "kernel/types.h"
+#include "kernel/kstat.h"
+#include "user/user.h"
+
+// Print file system statistics.
+// fsstat [command args...] runs the command first and
+// reports only the activity it caused.
+
+int
+main(int argc, char *argv[])
+{
+  struct fs_stat s0, s1;
+
+  memset(&s0, 0, sizeof(s0));
+  if(argc > 1){
+    if(kstat(KSTAT_FS, &s0, sizeof(s0)) < 0){
+      fprintf(2, "fsstat: kstat failed\n");
+      exit(1);
+    }
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "fsstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      fprintf(2, "fsstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+  if(kstat(KSTAT_FS, &s1, sizeof(s1)) < 0){
+    fprintf(2, "fsstat: kstat failed\n");
+    exit(1);
+  }
+
+  uint64 hits = s1.dcache_hits - s0.dcache_hits;
+  uint64 misses = s1.dcache_misses - s0.dcache_misses;
+
+  printf("dcache hits: %ld misses: %ld", hits, misses);
+  if(hits + misses > 0)
+    printf(" (%ld%% hit)", hits * 100 / (hits + misses));
+  printf("\n");
+
+  hits = s1.iget_hits - s0.iget_hits;
+  misses = s1.iget_misses - s0.iget_misses;
+  printf("inode table: %ld entries, iget hits: %ld misses: %ld",
+         s1.inodes, hits, misses);
+  if(hits + misses > 0)
+    printf(" (%ld%% hit)", hits * 100 / (hits + misses));
+  printf("\n");
+  printf("free blocks: %ld\n", s1.blocks_free);
+
+  hits = s1.bmap_hits - s0.bmap_hits;
+  misses = s1.bmap_misses - s0.bmap_misses;
+  printf("bmap run hits: %ld misses: %ld", hits, misses);
+  if(hits + misses > 0)
+    printf(" (%ld%% hit)", hits * 100 / (hits + misses));
+  printf("\n");
+  exit(0);
+}
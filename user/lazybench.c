@@ -0,0 +1,104 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/kstat.h"
+#include "user/user.h"
+
+// lazybench [mb [window]]: touch mb megabytes of lazily
+// allocated memory in order, first with fault-around off and
+// then with a window of up to window pages, and report the
+// faults taken and the time each run needed. Megapages are
+// turned off meanwhile so that every page is faulted.
+
+static struct proc_fault_stat procs[NPROC];
+
+// this process's fault counts.
+static int
+myfaults(struct fault_stat *f)
+{
+  int n, pid = getpid();
+
+  if((n = kstat(KSTAT_PROCVM, procs, sizeof(procs))) < 0)
+    return -1;
+  for(int i = 0; i < n / sizeof(procs[0]); i++){
+    if(procs[i].pid == pid){
+      *f = procs[i].f;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static void
+run(int mb)
+{
+  struct fault_stat f0, f1;
+  uint64 n = (uint64)mb << 20;
+  char *p;
+  int t0, t1;
+
+  if((p = sbrklazy(n)) == SBRK_ERROR){
+    fprintf(2, "lazybench: sbrk failed\n");
+    exit(1);
+  }
+  if(myfaults(&f0) < 0){
+    fprintf(2, "lazybench: kstat failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  for(uint64 i = 0; i < n; i += 4096)
+    p[i] = 1;
+  t1 = uptime();
+  myfaults(&f1);
+
+  printf("  %ld faults for %ld pages, %d ms\n", f1.lazy - f0.lazy,
+         f1.lazy_pages - f0.lazy_pages, (t1 - t0) * 1000 / tickhz(0));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb = 16, win = 0;
+  int oldwin, oldmega, xstatus;
+
+  if(argc > 3){
+    fprintf(2, "usage: lazybench [mb [window]]\n");
+    exit(1);
+  }
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  if(argc > 2 && (win = atoi(argv[2])) <= 0){
+    fprintf(2, "lazybench: bad window %s\n", argv[2]);
+    exit(1);
+  }
+  if(mb <= 0){
+    fprintf(2, "lazybench: bad size\n");
+    exit(1);
+  }
+
+  oldwin = faultaround(0);
+  oldmega = megapages(-1);
+  megapages(0);
+  if(win == 0)
+    win = oldwin;
+  for(int i = 0; i < 2; i++){
+    int w = i == 0 ? 1 : win;
+    faultaround(w);
+    printf("window %d:\n", faultaround(0));
+    // a fresh address space for each run.
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "lazybench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      run(mb);
+      exit(0);
+    }
+    wait(&xstatus);
+    if(xstatus != 0)
+      break;
+  }
+  faultaround(oldwin);
+  megapages(oldmega);
+  exit(0);
+}
@@ -127,8 +127,55 @@ void print_csv(struct lock_stat_data *stats, int count) {
 }
 
 
+// --- Per-process view: lockstat -p <pid> ---
+// Lock classes the process acquires most, by total spin time.
+int print_proc(int pid) {
+    static struct proc_lock_stat_raw st[PROC_LOCK_CLASSES];
+    int n = plockstat(pid, st, PROC_LOCK_CLASSES);
+
+    if (n < 0) {
+        fprintf(2, "lockstat: no process %d\n", pid);
+        return -1;
+    }
+
+    for (int i = 0; i < n - 1; i++) {
+        for (int j = 0; j < n - i - 1; j++) {
+            if (st[j].total_wait_time < st[j + 1].total_wait_time) {
+                struct proc_lock_stat_raw temp = st[j];
+                st[j] = st[j + 1];
+                st[j + 1] = temp;
+            }
+        }
+    }
+
+    fprintf(1, "Locks acquired by pid %d (top %d classes)\n", pid, PROC_LOCK_CLASSES);
+    fprintf(1, "=================================================================\n");
+    fprintf(1, "| %s | %s | %s | %s | %s |\n",
+        "LOCK NAME", "ACQ", "CONT", "SPIN (cycles)", "HOLD (cycles)");
+    fprintf(1, "=================================================================\n");
+    for (int i = 0; i < n; i++) {
+        fprintf(1, "| %s | %d | %d | %d | %d |\n",
+            st[i].name,
+            (int)st[i].acquire_count,
+            (int)st[i].contention_count,
+            (int)st[i].total_wait_time,
+            (int)st[i].total_hold_time);
+    }
+    fprintf(1, "=================================================================\n");
+    return 0;
+}
+
+
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && strcmp(argv[1], "-p") == 0) {
+        if (argc != 3) {
+            fprintf(2, "usage: lockstat -p <pid>\n");
+            exit(1);
+        }
+        exit(print_proc(atoi(argv[2])) < 0 ? 1 : 0);
+    }
+
     // Kích thước bytes cần thiết để copy từ Kernel
     int len_bytes = sizeof(raw_stats_buffer); 
 
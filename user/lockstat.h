@@ -25,3 +25,15 @@ struct lock_stat_data {
     unsigned int contention_x10;
     uint64 avg_hold_time;
 };
+
+#define PROC_LOCK_CLASSES 8
+
+// Must match struct proc_lock_stat in kernel/lockstat.h
+struct proc_lock_stat_raw {
+    char name[MAX_LOCK_NAME];
+    int class;
+    uint64 acquire_count;
+    uint64 contention_count;
+    uint64 total_wait_time;
+    uint64 total_hold_time;
+};
@@ -0,0 +1,66 @@
+#include "kernel/types.h"
+#include "kernel/kstat.h"
+#include "user/user.h"
+
+// Print the logging layer's commit statistics.
+// logstat [command args...] runs the command first and
+// reports only the commits it caused.
+
+int
+main(int argc, char *argv[])
+{
+  struct log_stat s0, s1;
+
+  memset(&s0, 0, sizeof(s0));
+  if(argc > 1){
+    if(kstat(KSTAT_LOG, &s0, sizeof(s0)) < 0){
+      fprintf(2, "logstat: kstat failed\n");
+      exit(1);
+    }
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "logstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      fprintf(2, "logstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+  if(kstat(KSTAT_LOG, &s1, sizeof(s1)) < 0){
+    fprintf(2, "logstat: kstat failed\n");
+    exit(1);
+  }
+
+  uint64 commits = s1.commits - s0.commits;
+  uint64 trans = s1.trans - s0.trans;
+  uint64 blocks = s1.blocks - s0.blocks;
+  uint64 cycles = s1.commit_cycles - s0.commit_cycles;
+  uint64 writes = s1.writes - s0.writes;
+  uint64 absorbed = s1.absorbed - s0.absorbed;
+  uint64 waits = s1.waits - s0.waits;
+  uint64 wcycles = s1.wait_cycles - s0.wait_cycles;
+
+  printf("log size: %ld blocks\n", s1.size);
+  printf("commits: %ld\n", commits);
+  printf("transactions: %ld\n", trans);
+  printf("blocks: %ld\n", blocks);
+  if(commits > 0){
+    printf("transactions/commit: %ld\n", trans / commits);
+    printf("blocks/commit: %ld\n", blocks / commits);
+    printf("avg commit: %ld cycles\n", cycles / commits);
+  }
+  printf("max blocks/commit: %ld\n", s1.max_blocks);
+  printf("max commit: %ld cycles\n", s1.max_commit_cycles);
+  printf("log writes: %ld, absorbed: %ld", writes, absorbed);
+  if(writes > 0)
+    printf(" (%ld%%)", absorbed * 100 / writes);
+  printf("\n");
+  printf("begin_op waits: %ld", waits);
+  if(waits > 0)
+    printf(", avg %ld cycles", wcycles / waits);
+  printf("\n");
+  exit(0);
+}
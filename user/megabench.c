@@ -0,0 +1,94 @@
+#include "kernel/types.h"
+#include "kernel/kstat.h"
+#include "user/user.h"
+
+// megabench [mb [passes]]: fault in mb megabytes of lazily
+// allocated memory and then read it passes times, first with
+// 4 KiB pages and then with 2 MiB megapages, and report the
+// page-table pages and time each needed.
+
+#define MEGASIZE (2*1024*1024)
+
+static int hz;
+
+static int
+ms(int ticks)
+{
+  return ticks * 1000 / hz;
+}
+
+static void
+run(int mb, int passes)
+{
+  struct vm_stat s0, s1;
+  uint64 n = (uint64)mb << 20, sum = 0;
+  char *cur, *p;
+  int t0, t1, t2;
+
+  // start the region on a megapage boundary.
+  cur = sbrklazy(0);
+  if(sbrklazy((MEGASIZE - (uint64)cur % MEGASIZE) % MEGASIZE) == SBRK_ERROR ||
+     (p = sbrklazy(n)) == SBRK_ERROR){
+    fprintf(2, "megabench: sbrk failed\n");
+    exit(1);
+  }
+
+  kstat(KSTAT_VM, &s0, sizeof(s0));
+  t0 = uptime();
+  for(uint64 i = 0; i < n; i += 4096)
+    p[i] = 1;
+  t1 = uptime();
+  kstat(KSTAT_VM, &s1, sizeof(s1));
+
+  for(int pass = 0; pass < passes; pass++)
+    for(uint64 *w = (uint64*)p; w < (uint64*)(p + n); w++)
+      sum += *w;
+  t2 = uptime();
+
+  printf("  %ld page-table pages, %ld megapages\n",
+         s1.pt_pages - s0.pt_pages, s1.mega_mapped - s0.mega_mapped);
+  printf("  fault in: %d ms, %d reads: %d ms (sum %ld)\n",
+         ms(t1 - t0), passes, ms(t2 - t1), sum);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb = 16, passes = 4;
+  int old, xstatus;
+
+  if(argc > 3){
+    fprintf(2, "usage: megabench [mb [passes]]\n");
+    exit(1);
+  }
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  if(argc > 2)
+    passes = atoi(argv[2]);
+  if(mb <= 0 || passes < 0){
+    fprintf(2, "megabench: bad size\n");
+    exit(1);
+  }
+  hz = tickhz(0);
+
+  old = megapages(-1);
+  for(int on = 0; on <= 1; on++){
+    printf("%s:\n", on ? "megapages" : "4 KiB pages");
+    megapages(on);
+    // a fresh address space for each run.
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "megabench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      run(mb, passes);
+      exit(0);
+    }
+    wait(&xstatus);
+    if(xstatus != 0)
+      break;
+  }
+  megapages(old);
+  exit(0);
+}
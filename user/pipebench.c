@@ -0,0 +1,75 @@
+#include "kernel/types.h"
+#include "user/user.h"
+
+// pipebench [mb [bs]]: push mb megabytes through a pipe
+// from a child to its parent in bs-byte writes and reads,
+// and report the throughput.
+
+#define MAXBS 16384
+
+char buf[MAXBS];
+
+int
+main(int argc, char *argv[])
+{
+  int mb = 4, bs = 4096;
+  int fds[2], pid, n, xstatus;
+  uint64 total, got;
+
+  if(argc > 3){
+    fprintf(2, "usage: pipebench [mb [bs]]\n");
+    exit(1);
+  }
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  if(argc > 2)
+    bs = atoi(argv[2]);
+  if(mb <= 0 || bs <= 0 || bs > MAXBS){
+    fprintf(2, "pipebench: bad size\n");
+    exit(1);
+  }
+  total = (uint64)mb << 20;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "pipebench: pipe failed\n");
+    exit(1);
+  }
+  int t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pipebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    memset(buf, 'p', bs);
+    for(uint64 sent = 0; sent < total; sent += n){
+      n = total - sent < bs ? total - sent : bs;
+      if(write(fds[1], buf, n) != n){
+        fprintf(2, "pipebench: write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+
+  close(fds[1]);
+  got = 0;
+  while((n = read(fds[0], buf, bs)) > 0)
+    got += n;
+  close(fds[0]);
+  wait(&xstatus);
+  int t1 = uptime();
+
+  if(got != total || xstatus != 0){
+    fprintf(2, "pipebench: moved %d of %d bytes\n", (int)got, (int)total);
+    exit(1);
+  }
+  int hz = tickhz(0);
+  int ms = (t1 - t0) * 1000 / hz;
+  if(ms == 0)
+    ms = 1;
+  printf("%d MB in %d-byte chunks: %d ms, %d KB/s\n",
+         mb, bs, ms, (int)(total / 1024 * 1000 / ms));
+  exit(0);
+}
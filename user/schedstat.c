@@ -0,0 +1,76 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/kstat.h"
+#include "user/user.h"
+
+// Print scheduling statistics: how long RUNNABLE processes
+// wait before running, wakeup-to-run latency, and context
+// switch counts, for the whole system and for each process.
+// Times are in timer cycles.
+
+static struct proc_sched_stat procs[NPROC];
+
+static void
+printhist(char *title, uint64 *h)
+{
+  uint64 max = 0;
+  int last = -1;
+
+  for(int i = 0; i < NSCHEDHIST; i++){
+    if(h[i] > max)
+      max = h[i];
+    if(h[i])
+      last = i;
+  }
+  printf("%s\n", title);
+  if(last < 0){
+    printf("  (none)\n");
+    return;
+  }
+  for(int i = 0; i <= last; i++){
+    if(i == NSCHEDHIST-1)
+      printf("  >= %ld: %ld ", 1L << i, h[i]);
+    else
+      printf("  < %ld: %ld ", 1L << (i+1), h[i]);
+    for(int j = 0; j < h[i] * 40 / max; j++)
+      printf("*");
+    printf("\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sched_stat s;
+  int n;
+
+  if(kstat(KSTAT_SCHED, &s, sizeof(s)) < 0){
+    fprintf(2, "schedstat: kstat failed\n");
+    exit(1);
+  }
+
+  printf("voluntary switches: %ld\n", s.nvcsw);
+  printf("involuntary switches: %ld\n", s.nivcsw);
+  printf("runs: %ld", s.runs);
+  if(s.runs > 0)
+    printf(", avg runnable delay %ld cycles", s.delay / s.runs);
+  printf("\n");
+  printhist("runnable to running (cycles):", s.rundelay);
+  printhist("wakeup to running (cycles):", s.wakelat);
+
+  n = kstat(KSTAT_PROC, procs, sizeof(procs));
+  if(n < 0){
+    fprintf(2, "schedstat: kstat failed\n");
+    exit(1);
+  }
+  n /= sizeof(procs[0]);
+
+  printf("\npid\tvol\tinvol\truns\tavg delay\tname\n");
+  for(int i = 0; i < n; i++){
+    struct proc_sched_stat *p = &procs[i];
+    printf("%d\t%ld\t%ld\t%ld\t%ld\t\t%s\n", p->pid, p->s.nvcsw,
+           p->s.nivcsw, p->s.runs,
+           p->s.runs ? p->s.delay / p->s.runs : 0, p->name);
+  }
+  exit(0);
+}
@@ -0,0 +1,99 @@
+#include "kernel/types.h"
+#include "kernel/kstat.h"
+#include "kernel/syscall.h"
+#include "user/user.h"
+
+// System call profile: calls, latency and lock spin time
+// per system call. sysprof [command args...] runs the
+// command first and reports only the calls made meanwhile.
+// Times are in timer cycles.
+
+static char *names[NSYSCALLSTAT] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_pause]   "pause",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_lockstat] "lockstat",
+[SYS_kstat]   "kstat",
+[SYS_tickhz]  "tickhz",
+[SYS_plockstat] "plockstat",
+[SYS_megapages] "megapages",
+[SYS_faultaround] "faultaround",
+};
+
+static struct syscall_stat s0[NSYSCALLSTAT], s1[NSYSCALLSTAT];
+
+// upper bound of the bucket holding the q'th percentile call.
+static uint64
+percentile(uint64 *h, uint64 count, int q)
+{
+  uint64 want = (count * q + 99) / 100;
+  uint64 seen = 0;
+
+  for(int b = 0; b < NSYSHIST; b++){
+    seen += h[b];
+    if(seen >= want)
+      return 1L << (b+1);
+  }
+  return 1L << NSYSHIST;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1){
+    if(kstat(KSTAT_SYSCALL, s0, sizeof(s0)) < 0){
+      fprintf(2, "sysprof: kstat failed\n");
+      exit(1);
+    }
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "sysprof: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      fprintf(2, "sysprof: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+  if(kstat(KSTAT_SYSCALL, s1, sizeof(s1)) < 0){
+    fprintf(2, "sysprof: kstat failed\n");
+    exit(1);
+  }
+
+  printf("syscall\tcalls\tavg\tp50<\tp99<\tspin%%\n");
+  for(int i = 0; i < NSYSCALLSTAT; i++){
+    struct syscall_stat d;
+    d.count = s1[i].count - s0[i].count;
+    d.cycles = s1[i].cycles - s0[i].cycles;
+    d.spin = s1[i].spin - s0[i].spin;
+    for(int b = 0; b < NSYSHIST; b++)
+      d.hist[b] = s1[i].hist[b] - s0[i].hist[b];
+    if(d.count == 0)
+      continue;
+    printf("%s\t%ld\t%ld\t%ld\t%ld\t%ld\n",
+           names[i] ? names[i] : "?", d.count, d.cycles / d.count,
+           percentile(d.hist, d.count, 50), percentile(d.hist, d.count, 99),
+           d.cycles ? d.spin * 100 / d.cycles : 0);
+  }
+  exit(0);
+}
@@ -0,0 +1,29 @@
+#include "kernel/types.h"
+#include "user/user.h"
+
+// tickhz [hz]: print the clock tick rate, or set it.
+
+int
+main(int argc, char *argv[])
+{
+  int hz = 0;
+
+  if(argc > 2){
+    fprintf(2, "usage: tickhz [hz]\n");
+    exit(1);
+  }
+  if(argc == 2 && (hz = atoi(argv[1])) <= 0){
+    fprintf(2, "tickhz: bad rate %s\n", argv[1]);
+    exit(1);
+  }
+  int old = tickhz(hz);
+  if(old < 0){
+    fprintf(2, "tickhz: failed\n");
+    exit(1);
+  }
+  if(hz)
+    printf("%d -> %d Hz\n", old, hz);
+  else
+    printf("%d Hz\n", old);
+  exit(0);
+}
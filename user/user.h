@@ -26,6 +26,11 @@ int pause(int);
 int uptime(void);
 // lockstat syscall wrapper
 int lockstat(void *buf, int max_locks);
+int plockstat(int pid, void *buf, int max);
+int kstat(int kind, void *buf, int n);
+int tickhz(int hz);
+int megapages(int on);
+int faultaround(int n);
 
 // ulib.c
 int stat(const char*, struct stat*);
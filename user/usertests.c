@@ -578,6 +578,10 @@ writetest(char *s)
   }
 }
 
+// MAXFILE blocks no longer fit on the disk; write enough
+// to reach into the second block of the double-indirect area.
+#define BIGBLOCKS (NDIRECT + NINDIRECT + NINDIRECT + 1)
+
 void
 writebig(char *s)
 {
@@ -589,7 +593,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGBLOCKS; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed i=%d\n", s, i);
@@ -609,7 +613,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n != MAXFILE){
+      if(n != BIGBLOCKS){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -678,6 +682,100 @@ void dirtest(char *s)
   }
 }
 
+// a program can't be written or truncated while a process
+// runs it, since its pages are loaded on demand.
+void
+textbusy(char *s)
+{
+  int fd, in, n, pid, xstatus;
+  int p0[2], p1[2];
+  char buf[512];
+  char *args[] = { "catcopy", 0 };
+
+  // make a private copy of cat to run.
+  unlink("catcopy");
+  if((in = open("cat", O_RDONLY)) < 0){
+    printf("%s: open cat failed\n", s);
+    exit(1);
+  }
+  if((fd = open("catcopy", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create catcopy failed\n", s);
+    exit(1);
+  }
+  while((n = read(in, buf, sizeof(buf))) > 0){
+    if(write(fd, buf, n) != n){
+      printf("%s: write catcopy failed\n", s);
+      exit(1);
+    }
+  }
+  close(in);
+
+  if(pipe(p0) < 0 || pipe(p1) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(0);
+    dup(p0[0]);
+    close(1);
+    dup(p1[1]);
+    close(p0[0]);
+    close(p0[1]);
+    close(p1[0]);
+    close(p1[1]);
+    close(fd);
+    exec("catcopy", args);
+    exit(1);
+  }
+  close(p0[0]);
+  close(p1[1]);
+
+  // once a byte comes back, catcopy is running.
+  if(write(p0[1], "x", 1) != 1 || read(p1[0], buf, 1) != 1 || buf[0] != 'x'){
+    printf("%s: catcopy didn't echo\n", s);
+    exit(1);
+  }
+
+  if(write(fd, "garbage", 7) >= 0){
+    printf("%s: wrote a running program\n", s);
+    exit(1);
+  }
+  if((n = open("catcopy", O_RDWR)) >= 0){
+    printf("%s: opened a running program for writing\n", s);
+    exit(1);
+  }
+  if((n = open("catcopy", O_RDONLY|O_TRUNC)) >= 0){
+    printf("%s: truncated a running program\n", s);
+    exit(1);
+  }
+
+  // it still runs as it was.
+  if(write(p0[1], "y", 1) != 1 || read(p1[0], buf, 1) != 1 || buf[0] != 'y'){
+    printf("%s: catcopy broke\n", s);
+    exit(1);
+  }
+  close(p0[1]);
+  wait(&xstatus);
+  close(p1[0]);
+  if(xstatus != 0){
+    printf("%s: catcopy failed\n", s);
+    exit(1);
+  }
+
+  // and can be changed once it has exited.
+  if(write(fd, "x", 1) != 1){
+    printf("%s: write after exit failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("catcopy");
+}
+
 void
 exectest(char *s)
 {
@@ -2770,6 +2868,7 @@ struct test {
   {createtest, "createtest"},
   {dirtest, "dirtest"},
   {exectest, "exectest"},
+  {textbusy, "textbusy"},
   {pipe1, "pipe1"},
   {killstatus, "killstatus"},
   {preempt, "preempt"},
@@ -42,4 +42,9 @@ entry("getpid");
 entry("sbrk");
 entry("pause");
 entry("uptime");
-entry("lockstat");
\ No newline at end of file
+entry("lockstat");
+entry("kstat");
+entry("tickhz");
+entry("plockstat");
+entry("megapages");
+entry("faultaround");
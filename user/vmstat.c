@@ -0,0 +1,90 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/kstat.h"
+#include "user/user.h"
+
+// Print virtual memory statistics.
+// vmstat [command args...] runs the command first and
+// reports only the activity it caused.
+// vmstat -p lists each process's page faults.
+
+static struct proc_fault_stat procs[NPROC];
+
+static void
+procfaults(void)
+{
+  int n;
+
+  if((n = kstat(KSTAT_PROCVM, procs, sizeof(procs))) < 0){
+    fprintf(2, "vmstat: kstat failed\n");
+    exit(1);
+  }
+  n /= sizeof(procs[0]);
+
+  printf("pid\tlazy\tpages\tcow\texec\tname\n");
+  for(int i = 0; i < n; i++){
+    struct proc_fault_stat *p = &procs[i];
+    printf("%d\t%ld\t%ld\t%ld\t%ld\t%s\n", p->pid, p->f.lazy,
+           p->f.lazy_pages, p->f.cow, p->f.exec, p->name);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vm_stat s0, s1;
+
+  if(argc == 2 && strcmp(argv[1], "-p") == 0){
+    procfaults();
+    exit(0);
+  }
+
+  memset(&s0, 0, sizeof(s0));
+  if(argc > 1){
+    if(kstat(KSTAT_VM, &s0, sizeof(s0)) < 0){
+      fprintf(2, "vmstat: kstat failed\n");
+      exit(1);
+    }
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "vmstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      fprintf(2, "vmstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+  if(kstat(KSTAT_VM, &s1, sizeof(s1)) < 0){
+    fprintf(2, "vmstat: kstat failed\n");
+    exit(1);
+  }
+
+  uint64 shared = s1.cow_shared - s0.cow_shared;
+  uint64 faults = s1.cow_faults - s0.cow_faults;
+  uint64 copied = s1.cow_copied - s0.cow_copied;
+  uint64 reused = s1.cow_reused - s0.cow_reused;
+  uint64 epages = s1.exec_pages - s0.exec_pages;
+  uint64 efaults = s1.exec_faults - s0.exec_faults;
+  uint64 eshared = s1.exec_shared - s0.exec_shared;
+  uint64 mapped = s1.mega_mapped - s0.mega_mapped;
+  uint64 demoted = s1.mega_demoted - s0.mega_demoted;
+
+  printf("cow pages shared: %ld\n", shared);
+  printf("cow faults: %ld", faults);
+  if(shared > 0)
+    printf(" (%ld%% of shared)", faults * 100 / shared);
+  printf("\n");
+  printf("  copied: %ld, reused: %ld\n", copied, reused);
+  printf("exec pages: %ld\n", epages);
+  printf("exec faults: %ld", efaults);
+  if(epages > 0)
+    printf(" (%ld%% of pages)", efaults * 100 / epages);
+  printf("\n");
+  printf("  from page cache: %ld\n", eshared);
+  printf("megapages mapped: %ld, split: %ld\n", mapped, demoted);
+  printf("page-table pages: %ld\n", s1.pt_pages);
+  exit(0);
+}